@@ -0,0 +1,280 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#include "auditlog.hpp"
+
+#include "state.hpp"
+#include "util.hpp"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+namespace hostpwrctl
+{
+
+/** @brief Host state code flag, the chassis states are encoded without it */
+constexpr uint8_t hostStateFlag = 0x80;
+
+/** @brief Maximum number of the states in the record */
+constexpr size_t maxStates = 255;
+
+/** @brief State names indexed by the code, 0 is for the unknown state */
+static const char* const stateNames[] = {
+    "Unknown",
+    "Off",
+    "On",
+    "Running",
+    "TransitioningToRunning",
+    "TransitioningToOff",
+    "TransitioningToOn",
+    "Standby",
+    "Quiesced",
+    "DiagnosticMode",
+    "BadPower",
+};
+
+uint8_t encodeAuditState(const std::string& state)
+{
+    uint8_t flag = 0;
+    std::string name;
+    if (state.starts_with(hostStatePrefix))
+    {
+        flag = hostStateFlag;
+        name = state.substr(strlen(hostStatePrefix));
+    }
+    else if (state.starts_with(chassisStatePrefix))
+    {
+        name = state.substr(strlen(chassisStatePrefix));
+    }
+
+    auto it = std::find(std::begin(stateNames), std::end(stateNames), name);
+    if (it == std::end(stateNames))
+    {
+        return flag;
+    }
+    return flag | static_cast<uint8_t>(it - std::begin(stateNames));
+}
+
+std::string decodeAuditState(uint8_t code)
+{
+    size_t index = code & ~hostStateFlag;
+    std::string state = code & hostStateFlag ? "Host:" : "Chassis:";
+    state += index < std::size(stateNames) ? stateNames[index] : "Unknown";
+    return state;
+}
+
+/**
+ * @brief Open the log file for appending and lock it.
+ *        The lock is taken on the file which is still at the path, not on
+ *        the one just rotated by another process.
+ *
+ * @param path - audit log path
+ * @param st   - status of the opened file
+ *
+ * @return file descriptor or -1 on error
+ */
+static int openLocked(const char* path, struct stat& st)
+{
+    while (true)
+    {
+        int fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        if (fd == -1)
+        {
+            fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+            return -1;
+        }
+        if (flock(fd, LOCK_EX) == -1 || fstat(fd, &st) == -1)
+        {
+            fprintf(stderr, "Unable to lock %s: %s\n", path, strerror(errno));
+            close(fd);
+            return -1;
+        }
+
+        struct stat current;
+        if (stat(path, &current) == 0 && current.st_ino == st.st_ino &&
+            current.st_dev == st.st_dev)
+        {
+            return fd;
+        }
+        close(fd);
+    }
+}
+
+bool appendAuditEntry(const char* path, const AuditEntry& entry,
+                      size_t maxSize)
+{
+    if (!createParentDir(path))
+    {
+        return false;
+    }
+
+    size_t commandSize = std::min<size_t>(entry.command.size(), UINT8_MAX);
+    size_t statesSize = std::min(entry.states.size(), maxStates);
+
+    AuditRecord::Header header{AuditRecord::magicValue,
+                               AuditRecord::layoutVersion};
+    AuditRecord record{};
+    record.size =
+        static_cast<uint16_t>(sizeof(record) + commandSize + statesSize);
+    record.result = static_cast<uint8_t>(entry.result);
+    record.command = static_cast<uint8_t>(commandSize);
+    record.uid = static_cast<uint32_t>(entry.uid);
+    record.pid = static_cast<uint32_t>(entry.pid);
+    record.duration = entry.duration;
+    record.start = entry.start;
+
+    std::vector<uint8_t> data(sizeof(header) + record.size);
+    auto pos = data.data() + sizeof(header);
+    memcpy(pos, &record, sizeof(record));
+    pos += sizeof(record);
+    memcpy(pos, entry.command.data(), commandSize);
+    pos += commandSize;
+    std::copy_n(entry.states.begin(), statesSize, pos);
+
+    struct stat st;
+    int fd = openLocked(path, st);
+    if (fd == -1)
+    {
+        return false;
+    }
+    if (st.st_size > static_cast<off_t>(sizeof(header)) &&
+        static_cast<size_t>(st.st_size) + record.size > maxSize)
+    {
+        std::string rotated = std::string(path) + ".1";
+        if (rename(path, rotated.c_str()) == -1)
+        {
+            fprintf(stderr, "Unable to rotate %s: %s\n", path,
+                    strerror(errno));
+            close(fd);
+            return false;
+        }
+        close(fd);
+        fd = openLocked(path, st);
+        if (fd == -1)
+        {
+            return false;
+        }
+    }
+
+    // The header goes along with the first record
+    size_t offset = 0;
+    if (st.st_size == 0)
+    {
+        memcpy(data.data(), &header, sizeof(header));
+    }
+    else
+    {
+        offset = sizeof(header);
+    }
+
+    ssize_t size = static_cast<ssize_t>(data.size() - offset);
+    bool written = write(fd, data.data() + offset, size) == size;
+    if (!written)
+    {
+        fprintf(stderr, "Unable to write %s: %s\n", path, strerror(errno));
+    }
+    close(fd);
+
+    return written;
+}
+
+/**
+ * @brief Read the records of the single log file
+ *
+ * @param path    - log file path
+ * @param entries - destination
+ *
+ * @return false if the file can not be read
+ */
+static bool readAuditFile(const std::string& path,
+                          std::vector<AuditEntry>& entries)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return false;
+    }
+    std::vector<uint8_t> data;
+    uint8_t buf[4096];
+    ssize_t len;
+    while ((len = read(fd, buf, sizeof(buf))) > 0)
+    {
+        data.insert(data.end(), buf, buf + len);
+    }
+    close(fd);
+    if (len == -1)
+    {
+        fprintf(stderr, "Unable to read %s: %s\n", path.c_str(),
+                strerror(errno));
+        return false;
+    }
+
+    AuditRecord::Header header;
+    if (data.size() < sizeof(header))
+    {
+        // Created but not written yet
+        return true;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    if (header.magic != AuditRecord::magicValue ||
+        header.version != AuditRecord::layoutVersion)
+    {
+        fprintf(stderr, "Audit log %s has unsupported format\n",
+                path.c_str());
+        return false;
+    }
+
+    size_t offset = sizeof(header);
+    while (data.size() - offset >= sizeof(AuditRecord))
+    {
+        AuditRecord record;
+        memcpy(&record, data.data() + offset, sizeof(record));
+        if (record.size < sizeof(record) + record.command ||
+            record.size > data.size() - offset)
+        {
+            // Torn write at the end of the file
+            break;
+        }
+
+        auto pos = data.data() + offset + sizeof(record);
+        auto end = data.data() + offset + record.size;
+        AuditEntry entry;
+        entry.command.assign(reinterpret_cast<const char*>(pos),
+                             record.command);
+        entry.states.assign(pos + record.command, end);
+        entry.uid = static_cast<uid_t>(record.uid);
+        entry.pid = static_cast<pid_t>(record.pid);
+        entry.start = record.start;
+        entry.duration = record.duration;
+        entry.result = record.result;
+        entries.push_back(std::move(entry));
+
+        offset += record.size;
+    }
+
+    return true;
+}
+
+bool readAuditLog(const char* path, std::vector<AuditEntry>& entries)
+{
+    bool rotated = readAuditFile(std::string(path) + ".1", entries);
+    bool current = readAuditFile(path, entries);
+    if (!rotated && !current)
+    {
+        fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+} // namespace hostpwrctl
@@ -0,0 +1,117 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace hostpwrctl
+{
+
+/**
+ * @brief Layout of the audit log file.
+ *
+ *        The file starts with the header, the records follow back to back.
+ *        Each record is the fixed part below followed by the command line
+ *        and the one byte codes of the power states seen, so the typical
+ *        record takes 40-60 bytes. The record is written with the single
+ *        append, the incomplete record at the end of the file is ignored.
+ */
+struct AuditRecord
+{
+    static constexpr uint32_t magicValue = 0x4C415048; // "HPAL"
+    static constexpr uint32_t layoutVersion = 1;
+
+    /** @brief File header */
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+    };
+
+    uint16_t size;     // record size including the command and the states
+    uint8_t result;    // exit code
+    uint8_t command;   // command line length
+    uint32_t uid;      // real user ID of the caller
+    uint32_t pid;      // process ID of the caller
+    uint32_t duration; // invocation duration, ms
+    uint64_t start;    // CLOCK_REALTIME time of the start, ms
+};
+
+static_assert(sizeof(AuditRecord) == 24, "Audit record layout is changed");
+
+/**
+ * @brief Decoded audit log record
+ */
+struct AuditEntry
+{
+    std::string command;         // command line
+    uid_t uid;                   // real user ID of the caller
+    pid_t pid;                   // process ID of the caller
+    uint64_t start;              // CLOCK_REALTIME time of the start, ms
+    uint32_t duration;           // invocation duration, ms
+    int result;                  // exit code
+    std::vector<uint8_t> states; // codes of the power states seen
+};
+
+/** @brief Default audit log path, on the persistent storage */
+constexpr auto auditLogPath = "/var/lib/hostpwrctl/audit.log";
+
+/**
+ * @brief Size limit of the audit log file, the full file is renamed with
+ *        the '.1' suffix replacing the previous one, so the log takes
+ *        twice the limit at most
+ */
+constexpr size_t auditLogMaxSize = 64 * 1024;
+
+/**
+ * @brief Encode the chassis or host state to the one byte code
+ *
+ * @param state - D-Bus value of the state
+ *
+ * @return state code, the unknown states are encoded as 'Unknown'
+ */
+uint8_t encodeAuditState(const std::string& state);
+
+/**
+ * @brief Decode the state code
+ *
+ * @param code - state code
+ *
+ * @return state description, e.g. 'Host:Running'
+ */
+std::string decodeAuditState(uint8_t code);
+
+/**
+ * @brief Append the record to the audit log, rotate the log if the record
+ *        does not fit.
+ *        The file is locked while written, so the concurrent invocations
+ *        do not mix the records.
+ *
+ * @param path    - audit log path
+ * @param entry   - record to append
+ * @param maxSize - file size limit
+ *
+ * @return false on error
+ */
+bool appendAuditEntry(const char* path, const AuditEntry& entry,
+                      size_t maxSize = auditLogMaxSize);
+
+/**
+ * @brief Read the audit log including the rotated part, the oldest record
+ *        first
+ *
+ * @param path    - audit log path
+ * @param entries - destination
+ *
+ * @return false if none of the files can be read
+ */
+bool readAuditLog(const char* path, std::vector<AuditEntry>& entries);
+
+} // namespace hostpwrctl
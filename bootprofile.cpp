@@ -0,0 +1,219 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#include "bootprofile.hpp"
+
+#include "util.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+
+namespace hostpwrctl
+{
+
+/**
+ * @brief Minimal slowdown treated as regression, smaller deviations of
+ *        the short phases are the measurement noise
+ */
+constexpr auto minRegression = std::chrono::seconds(1);
+
+void BootProfile::start()
+{
+    phases.clear();
+    finished = false;
+    phases.push_back({"Request", Clock::now(), {}, 0, 0});
+}
+
+void BootProfile::mark(const std::string& name)
+{
+    if (phases.empty() || finished || phases.back().name == name)
+    {
+        return;
+    }
+
+    auto now = Clock::now();
+    close(now);
+    phases.push_back({name, now, {}, 0, 0});
+}
+
+void BootProfile::postCode(uint64_t code)
+{
+    if (phases.empty() || finished)
+    {
+        return;
+    }
+
+    ++phases.back().postCodes;
+    phases.back().lastPostCode = code;
+}
+
+void BootProfile::finish()
+{
+    if (phases.empty() || finished)
+    {
+        return;
+    }
+
+    close(Clock::now());
+    finished = true;
+}
+
+void BootProfile::close(Clock::time_point now)
+{
+    phases.back().duration = now - phases.back().start;
+}
+
+void BootProfile::report(FILE* out) const
+{
+    if (phases.empty())
+    {
+        return;
+    }
+
+    fprintf(out, "Boot phases:\n");
+    fprintf(out, "  %-28s %10s %12s %10s\n", "Phase", "Start, s",
+            "Duration, s", "POST codes");
+
+    const auto begin = phases.front().start;
+    Clock::duration total{};
+    for (const auto& phase : phases)
+    {
+        fprintf(out, "  %-28s %10.3f %12.3f %10zu", phase.name.c_str(),
+                toSeconds(phase.start - begin), toSeconds(phase.duration),
+                phase.postCodes);
+        if (phase.postCodes)
+        {
+            fprintf(out, " (last 0x%llx)",
+                    static_cast<unsigned long long>(phase.lastPostCode));
+        }
+        fprintf(out, "\n");
+        total = phase.start - begin + phase.duration;
+    }
+    fprintf(out, "Total: %.3f s\n", toSeconds(total));
+}
+
+BootProfile::Durations BootProfile::getDurations() const
+{
+    Durations durations;
+    Clock::duration total{};
+    for (const auto& phase : phases)
+    {
+        auto it = std::find_if(
+            durations.begin(), durations.end(),
+            [&phase](const auto& item) { return item.first == phase.name; });
+        if (it == durations.end())
+        {
+            durations.emplace_back(phase.name, phase.duration);
+        }
+        else
+        {
+            it->second += phase.duration;
+        }
+        total += phase.duration;
+    }
+    durations.emplace_back("Total", total);
+    return durations;
+}
+
+bool BootProfile::saveBaseline(const std::string& path) const
+{
+    return saveDurations(path, getDurations());
+}
+
+bool BootProfile::saveDurations(const std::string& path,
+                                const Durations& durations)
+{
+    if (!createParentDir(path))
+    {
+        return false;
+    }
+
+    // Write to the temporary file to never leave the truncated baseline
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::trunc);
+        for (const auto& [name, duration] : durations)
+        {
+            file << name << ' '
+                 << std::chrono::duration_cast<std::chrono::microseconds>(
+                        duration)
+                        .count()
+                 << '\n';
+        }
+        if (!file.good())
+        {
+            fprintf(stderr, "Unable to write %s\n", tmp.c_str());
+            return false;
+        }
+    }
+    if (rename(tmp.c_str(), path.c_str()) == -1)
+    {
+        fprintf(stderr, "Unable to save %s: %s\n", path.c_str(),
+                strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+BootProfile::Durations BootProfile::loadBaseline(const std::string& path)
+{
+    Durations durations;
+    std::ifstream file(path);
+    std::string name;
+    int64_t usec;
+    while (file >> name >> usec)
+    {
+        durations.emplace_back(name, std::chrono::microseconds(usec));
+    }
+    return durations;
+}
+
+bool BootProfile::compare(const Durations& baseline, unsigned tolerance,
+                          FILE* out) const
+{
+    bool regression = false;
+
+    fprintf(out, "Baseline comparison (tolerance %u%%):\n", tolerance);
+    for (const auto& [name, duration] : getDurations())
+    {
+        auto it = std::find_if(
+            baseline.begin(), baseline.end(),
+            [&name = name](const auto& item) { return item.first == name; });
+        if (it == baseline.end())
+        {
+            fprintf(out, "  phase=%s measured=%.3f status=new\n", name.c_str(),
+                    toSeconds(duration));
+            continue;
+        }
+
+        const auto delta = duration - it->second;
+        const auto allowed = it->second * tolerance / 100;
+        const char* status = "ok";
+        if (delta > allowed && delta >= minRegression)
+        {
+            status = "regression";
+            regression = true;
+        }
+        else if (-delta > allowed && -delta >= minRegression)
+        {
+            status = "improvement";
+        }
+
+        fprintf(out, "  phase=%s baseline=%.3f measured=%.3f", name.c_str(),
+                toSeconds(it->second), toSeconds(duration));
+        if (it->second.count())
+        {
+            fprintf(out, " delta=%+.1f%%", 100.0 * delta / it->second);
+        }
+        fprintf(out, " status=%s\n", status);
+    }
+
+    return regression;
+}
+
+} // namespace hostpwrctl
@@ -0,0 +1,145 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace hostpwrctl
+{
+
+/**
+ * @brief Boot phases profiler.
+ *        Records the time of each observed boot phase (power state changes,
+ *        BootProgress values) and the POST codes received during the phase.
+ */
+class BootProfile
+{
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    /** @brief Boot phase */
+    struct Phase
+    {
+        std::string name;
+        Clock::time_point start;
+        Clock::duration duration;
+        size_t postCodes;
+        uint64_t lastPostCode;
+    };
+
+    /**
+     * @brief Start profiling, the initial phase is the request processing
+     */
+    void start();
+
+    /**
+     * @brief Check if profiling is started
+     */
+    bool isActive() const
+    {
+        return !phases.empty();
+    }
+
+    /**
+     * @brief Record the beginning of the next phase,
+     *        the repeated phase is ignored
+     *
+     * @param name - phase name
+     */
+    void mark(const std::string& name);
+
+    /**
+     * @brief Record the POST code received in the current phase
+     *
+     * @param code - POST code
+     */
+    void postCode(uint64_t code);
+
+    /**
+     * @brief Finish profiling, the current phase is closed
+     */
+    void finish();
+
+    /**
+     * @brief Get the recorded phases
+     */
+    const std::vector<Phase>& getPhases() const
+    {
+        return phases;
+    }
+
+    /**
+     * @brief Print the per-phase duration report
+     *
+     * @param out - output stream
+     */
+    void report(FILE* out) const;
+
+    /** @brief Phase durations in order of appearance */
+    using Durations = std::vector<std::pair<std::string, Clock::duration>>;
+
+    /**
+     * @brief Get the total duration of each phase,
+     *        the repeated phases are summed up
+     */
+    Durations getDurations() const;
+
+    /**
+     * @brief Save the phase durations as the baseline
+     *
+     * @param path - baseline file path
+     *
+     * @return false on error
+     */
+    bool saveBaseline(const std::string& path) const;
+
+    /**
+     * @brief Save the phase durations in the baseline format
+     *
+     * @param path      - file path
+     * @param durations - phase durations
+     *
+     * @return false on error
+     */
+    static bool saveDurations(const std::string& path,
+                              const Durations& durations);
+
+    /**
+     * @brief Load the baseline phase durations
+     *
+     * @param path - baseline file path
+     *
+     * @return phase durations, empty if the baseline is not available
+     */
+    static Durations loadBaseline(const std::string& path);
+
+    /**
+     * @brief Compare the phase durations with the baseline and print
+     *        the report, one key=value record per phase
+     *
+     * @param baseline  - baseline phase durations
+     * @param tolerance - allowed deviation, percent
+     * @param out       - output stream
+     *
+     * @return true if any phase is slower than allowed
+     */
+    bool compare(const Durations& baseline, unsigned tolerance,
+                 FILE* out) const;
+
+  private:
+    /** @brief Close the current phase */
+    void close(Clock::time_point now);
+
+    std::vector<Phase> phases;
+    bool finished = false;
+};
+
+} // namespace hostpwrctl
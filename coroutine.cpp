@@ -0,0 +1,60 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#include "coroutine.hpp"
+
+#include <systemd/sd-event.h>
+
+#include <cstring>
+
+namespace hostpwrctl
+{
+
+/**
+ * @brief Resume the coroutine and release the one-shot source
+ *
+ * @param source   - defer event source
+ * @param userdata - coroutine handle address
+ *
+ * @return always 0
+ */
+static int onResume(sd_event_source* source, void* userdata)
+{
+    // The source is freed by sd-event after the dispatching
+    sd_event_source_unref(source);
+    std::coroutine_handle<>::from_address(userdata).resume();
+    return 0;
+}
+
+void resumeLater(sd_event* event, std::coroutine_handle<> handle)
+{
+    sd_event_source* source = nullptr;
+    int rc = sd_event_add_defer(event, &source, onResume, handle.address());
+    if (rc < 0)
+    {
+        fprintf(stderr, "Unable to schedule the task: %s\n", strerror(-rc));
+        handle.resume();
+    }
+}
+
+void Sleep::await_suspend(std::coroutine_handle<> handle)
+{
+    timer.emplace(event, [this, handle](Timer&) {
+        resumeLater(event.get(), handle);
+    });
+    timer->restartOnce(duration);
+}
+
+bool MethodCall::await_suspend(std::coroutine_handle<> handle)
+{
+    sd_event* event = sd_bus_get_event(bus.get());
+    return callAsync(bus, method,
+                     [this, handle, event](sdbusplus::message::message& m) {
+                         reply.emplace(std::move(m));
+                         resumeLater(event, handle);
+                     });
+}
+
+} // namespace hostpwrctl
@@ -0,0 +1,471 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#pragma once
+
+#include "dbus.hpp"
+
+#include <sdbusplus/bus.hpp>
+#include <sdbusplus/bus/match.hpp>
+#include <sdeventplus/clock.hpp>
+#include <sdeventplus/event.hpp>
+#include <sdeventplus/utility/timer.hpp>
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace hostpwrctl
+{
+
+/*
+ * Coroutines on the sd-event loop.
+ *
+ * The awaitables below suspend the coroutine until the event loop
+ * delivers the result, so the multi-step operations are written linearly
+ * without blocking calls or threads:
+ *
+ *   Task<> reboot(PowerControl& power, sdeventplus::Event& event)
+ *   {
+ *       co_await power.run(PowerControl::Operation::soft);
+ *       co_await Sleep(event, std::chrono::seconds(5));
+ *       co_await power.run(PowerControl::Operation::on);
+ *   }
+ *
+ * The suspended coroutine is always resumed from the event loop, never
+ * from inside the bus or timer callback, so the awaitable is free to
+ * destroy its event sources after the resumption. The coroutine must not
+ * be destroyed while it is suspended.
+ */
+
+template <typename T>
+class Task;
+
+/**
+ * @brief Resume the suspended coroutine on the next event loop iteration
+ *
+ * @param event  - event loop
+ * @param handle - suspended coroutine
+ */
+void resumeLater(sd_event* event, std::coroutine_handle<> handle);
+
+/**
+ * @brief Task promise, the common part
+ */
+struct TaskPromiseBase
+{
+    /** @brief Resume the awaiting coroutine when the task is finished */
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept
+        {
+            return false;
+        }
+
+        template <typename P>
+        std::coroutine_handle<>
+            await_suspend(std::coroutine_handle<P> handle) noexcept
+        {
+            auto next = handle.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+
+        void await_resume() noexcept
+        {}
+    };
+
+    std::suspend_always initial_suspend() noexcept
+    {
+        return {};
+    }
+
+    FinalAwaiter final_suspend() noexcept
+    {
+        return {};
+    }
+
+    void unhandled_exception()
+    {
+        exception = std::current_exception();
+    }
+
+    /** @brief Rethrow the exception escaped the task body */
+    void check()
+    {
+        if (exception)
+        {
+            std::rethrow_exception(exception);
+        }
+    }
+
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+};
+
+/**
+ * @brief Task promise returning the value
+ */
+template <typename T>
+struct TaskPromise : TaskPromiseBase
+{
+    Task<T> get_return_object();
+
+    void return_value(T result)
+    {
+        value = std::move(result);
+    }
+
+    T result()
+    {
+        check();
+        return std::move(*value);
+    }
+
+    std::optional<T> value;
+};
+
+/**
+ * @brief Task promise without the value
+ */
+template <>
+struct TaskPromise<void> : TaskPromiseBase
+{
+    Task<void> get_return_object();
+
+    void return_void()
+    {}
+
+    void result()
+    {
+        check();
+    }
+};
+
+/**
+ * @brief Lazy coroutine, it is started when awaited or spawned
+ *
+ * @tparam T - result type
+ */
+template <typename T = void>
+class Task
+{
+  public:
+    using promise_type = TaskPromise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    explicit Task(Handle handle) : handle(handle)
+    {}
+
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, {}))
+    {}
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    Task& operator=(Task&&) = delete;
+
+    ~Task()
+    {
+        if (handle)
+        {
+            handle.destroy();
+        }
+    }
+
+    /** @brief Start the task and resume the caller when it is finished */
+    auto operator co_await() && noexcept
+    {
+        struct Awaiter
+        {
+            Handle handle;
+
+            bool await_ready() noexcept
+            {
+                return false;
+            }
+
+            std::coroutine_handle<>
+                await_suspend(std::coroutine_handle<> caller) noexcept
+            {
+                handle.promise().continuation = caller;
+                return handle;
+            }
+
+            T await_resume()
+            {
+                return handle.promise().result();
+            }
+        };
+        return Awaiter{handle};
+    }
+
+  private:
+    Handle handle;
+};
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object()
+{
+    return Task<T>(Task<T>::Handle::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object()
+{
+    return Task<void>(Task<void>::Handle::from_promise(*this));
+}
+
+/**
+ * @brief Coroutine owning itself, used to start the task from the plain
+ *        function
+ */
+struct DetachedTask
+{
+    struct promise_type
+    {
+        DetachedTask get_return_object() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void return_void()
+        {}
+
+        void unhandled_exception()
+        {
+            std::terminate();
+        }
+    };
+};
+
+/**
+ * @brief Start the task, it runs until the first suspension and then
+ *        continues from the event loop
+ *
+ * @param task - task to run
+ */
+inline DetachedTask spawn(Task<> task)
+{
+    try
+    {
+        co_await std::move(task);
+    }
+    catch (const std::exception& e)
+    {
+        fprintf(stderr, "Unhandled error in the task: %s\n", e.what());
+    }
+}
+
+/**
+ * @brief Awaitable pause
+ */
+class Sleep
+{
+  public:
+    /**
+     * @brief Constructor
+     *
+     * @param event    - event loop
+     * @param duration - pause duration
+     */
+    Sleep(const sdeventplus::Event& event,
+          std::chrono::microseconds duration) :
+        event(event),
+        duration(duration)
+    {}
+
+    bool await_ready() const noexcept
+    {
+        return duration.count() <= 0;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle);
+
+    void await_resume() const noexcept
+    {}
+
+  private:
+    using Timer = sdeventplus::utility::Timer<sdeventplus::ClockId::Monotonic>;
+
+    sdeventplus::Event event;
+    std::chrono::microseconds duration;
+    std::optional<Timer> timer;
+};
+
+/**
+ * @brief Awaitable D-Bus method call, the result is the reply message or
+ *        empty if the call can not be sent.
+ *        The bus must be attached to the event loop.
+ */
+class MethodCall
+{
+  public:
+    /**
+     * @brief Constructor
+     *
+     * @param bus    - D-Bus connection
+     * @param method - method call message
+     */
+    MethodCall(sdbusplus::bus::bus& bus, sdbusplus::message::message&& method) :
+        bus(bus), method(std::move(method))
+    {}
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle);
+
+    std::optional<sdbusplus::message::message> await_resume()
+    {
+        return std::move(reply);
+    }
+
+  private:
+    sdbusplus::bus::bus& bus;
+    sdbusplus::message::message method;
+    std::optional<sdbusplus::message::message> reply;
+};
+
+/**
+ * @brief Awaitable property value, the result is false if the value is not
+ *        reached within the timeout.
+ *        The current value is read when the wait starts, after that the
+ *        PropertiesChanged signals are tracked. The bus must be attached
+ *        to the event loop.
+ *
+ * @tparam T - property value type, one of the basic D-Bus types
+ */
+template <typename T>
+class PropertyWait
+{
+  public:
+    /**
+     * @brief Constructor
+     *
+     * @param bus     - D-Bus connection
+     * @param prop    - property descriptor
+     * @param value   - expected value
+     * @param timeout - maximum time to wait, 0 to wait forever
+     */
+    PropertyWait(sdbusplus::bus::bus& bus, const Property<T>& prop, T value,
+                 std::chrono::microseconds timeout) :
+        bus(bus),
+        prop(prop), value(std::move(value)), timeout(timeout)
+    {}
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        this->handle = handle;
+        sdeventplus::Event event(sd_bus_get_event(bus.get()));
+
+        match.emplace(
+            bus,
+            sdbusplus::bus::match::rules::propertiesChanged(prop.path,
+                                                            prop.iface),
+            [this](sdbusplus::message::message& m) {
+                std::string iface;
+                std::map<std::string, Value> data;
+                std::vector<std::string> invalidated;
+                m.read(iface, data, invalidated);
+
+                auto it = data.find(prop.name);
+                if (it != data.end())
+                {
+                    if (auto current = std::get_if<T>(&it->second))
+                    {
+                        check(*current);
+                    }
+                }
+            });
+
+        std::weak_ptr<bool> alive = lifetime;
+        readProperty(bus, prop, [this, alive](std::optional<T> current) {
+            if (!alive.expired() && current)
+            {
+                check(*current);
+            }
+        });
+
+        if (timeout.count())
+        {
+            timer.emplace(event, [this](Timer&) { finish(false); });
+            timer->restartOnce(timeout);
+        }
+    }
+
+    bool await_resume() const noexcept
+    {
+        return reached;
+    }
+
+  private:
+    using Timer = sdeventplus::utility::Timer<sdeventplus::ClockId::Monotonic>;
+
+    /** @brief Value of any property changed along with the awaited one */
+    using Value =
+        std::variant<std::string, bool, uint8_t, int16_t, uint16_t, int32_t,
+                     uint32_t, int64_t, uint64_t, double,
+                     std::vector<std::string>>;
+
+    /** @brief Finish the wait if the value is expected */
+    void check(const T& current)
+    {
+        if (current == value)
+        {
+            finish(true);
+        }
+    }
+
+    /** @brief Finish the wait and schedule the resumption */
+    void finish(bool success)
+    {
+        if (finished)
+        {
+            return;
+        }
+        finished = true;
+        reached = success;
+        resumeLater(sd_bus_get_event(bus.get()), handle);
+    }
+
+    sdbusplus::bus::bus& bus;
+    Property<T> prop;
+    T value;
+    std::chrono::microseconds timeout;
+    std::coroutine_handle<> handle;
+    std::optional<sdbusplus::bus::match::match> match;
+    std::optional<Timer> timer;
+    bool finished = false;
+    bool reached = false;
+
+    // Expires with the awaitable, checked by the Get reply handler
+    std::shared_ptr<bool> lifetime = std::make_shared<bool>(true);
+};
+
+} // namespace hostpwrctl
@@ -0,0 +1,237 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#include "dbus.hpp"
+
+#include "recorder.hpp"
+#include "trace.hpp"
+
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <set>
+
+namespace hostpwrctl
+{
+
+/** @brief Resolved service names by the object path and interface */
+static std::map<std::pair<std::string, std::string>, std::string> services;
+
+/**
+ * @brief Method call waiting for the reply
+ */
+struct PendingCall
+{
+    ReplyHandler handler;
+    uint64_t started;    // time of the call, filled if tracing is enabled
+    std::string name;    // method name, filled if tracing is enabled
+    std::string details; // call details, filled if tracing is enabled
+};
+
+/**
+ * @brief Replace missing message field with the placeholder
+ */
+static const char* orDash(const char* value)
+{
+    return value ? value : "-";
+}
+
+/**
+ * @brief Dispatch the method call reply to the handler
+ *
+ * @param reply    - method reply or error
+ * @param userdata - pointer to the pending call
+ *
+ * @return always 0, errors are handled by the reply handler
+ */
+static int onMethodReply(sd_bus_message* reply, void* userdata, sd_bus_error*)
+{
+    uint64_t cookie = 0;
+    sd_bus_message_get_reply_cookie(reply, &cookie);
+    const sd_bus_error* error = sd_bus_message_get_error(reply);
+    if (error)
+    {
+        flightRecorder().record(FlightRecorder::Event::error, "#%llu %s",
+                                static_cast<unsigned long long>(cookie),
+                                error->name);
+    }
+    else
+    {
+        flightRecorder().record(FlightRecorder::Event::reply, "#%llu",
+                                static_cast<unsigned long long>(cookie));
+    }
+
+    auto call = static_cast<PendingCall*>(userdata);
+    tracer().call(cookie, call->name, call->details, call->started,
+                  error ? error->name : nullptr);
+
+    sdbusplus::message::message m(reply);
+    try
+    {
+        call->handler(m);
+    }
+    catch (const std::exception& e)
+    {
+        fprintf(stderr, "Unable to handle method reply: %s\n", e.what());
+    }
+    return 0;
+}
+
+bool callAsync(sdbusplus::bus::bus& bus, sdbusplus::message::message& method,
+               ReplyHandler&& handler)
+{
+    sd_bus_message* m = method.get();
+    auto userdata = new PendingCall{std::move(handler), 0, {}, {}};
+    if (tracer().isEnabled())
+    {
+        userdata->started = Trace::now();
+        userdata->name = orDash(sd_bus_message_get_member(m));
+        userdata->details =
+            std::string(orDash(sd_bus_message_get_destination(m))) + ' ' +
+            orDash(sd_bus_message_get_path(m));
+    }
+
+    sd_bus_slot* slot = nullptr;
+    int rc = sd_bus_call_async(bus.get(), &slot, m, onMethodReply, userdata,
+                               0);
+    if (rc < 0)
+    {
+        delete userdata;
+        fprintf(stderr, "Unable to send method call: %s\n", strerror(-rc));
+        return false;
+    }
+
+    uint64_t cookie = 0;
+    sd_bus_message_get_cookie(m, &cookie);
+    flightRecorder().record(FlightRecorder::Event::call, "#%llu %s %s %s.%s",
+                            static_cast<unsigned long long>(cookie),
+                            orDash(sd_bus_message_get_destination(m)),
+                            orDash(sd_bus_message_get_path(m)),
+                            orDash(sd_bus_message_get_interface(m)),
+                            orDash(sd_bus_message_get_member(m)));
+
+    // The slot is owned by the bus and released after the reply handling
+    sd_bus_slot_set_destroy_callback(slot, [](void* p) {
+        delete static_cast<PendingCall*>(p);
+    });
+    sd_bus_slot_set_floating(slot, 1);
+    sd_bus_slot_unref(slot);
+
+    return true;
+}
+
+bool isReplyError(sdbusplus::message::message& reply, const char* what)
+{
+    const sd_bus_error* error = sd_bus_message_get_error(reply.get());
+    if (error)
+    {
+        fprintf(stderr, "Error occurred during %s, %s: %s\n", what,
+                error->name, error->message ? error->message : "");
+        return true;
+    }
+    return false;
+}
+
+void waitReplies(sdbusplus::bus::bus& bus, const size_t& pending)
+{
+    while (pending)
+    {
+        int rc = sd_bus_process(bus.get(), nullptr);
+        if (rc == 0)
+        {
+            rc = sd_bus_wait(bus.get(), UINT64_MAX);
+        }
+        if (rc < 0)
+        {
+            fprintf(stderr, "Unable to process D-Bus: %s\n", strerror(-rc));
+            break;
+        }
+    }
+}
+
+void resolveService(sdbusplus::bus::bus& bus, const std::string& path,
+                    const std::string& iface,
+                    std::function<void(const std::string&)>&& done)
+{
+    auto it = services.find({path, iface});
+    if (it != services.end())
+    {
+        done(it->second);
+        return;
+    }
+
+    auto method = bus.new_method_call(
+        "xyz.openbmc_project.ObjectMapper",
+        "/xyz/openbmc_project/object_mapper",
+        "xyz.openbmc_project.ObjectMapper", "GetObject");
+    method.append(path, std::vector<std::string>{iface});
+
+    auto onReply = [path, iface, done](sdbusplus::message::message& reply) {
+        if (isReplyError(reply, "the object mapper call"))
+        {
+            done(std::string());
+            return;
+        }
+
+        std::map<std::string, std::vector<std::string>> objects;
+        try
+        {
+            reply.read(objects);
+        }
+        catch (const sdbusplus::exception::SdBusError& e)
+        {
+            fprintf(stderr, "Invalid object mapper reply: %s\n", e.what());
+        }
+        if (objects.empty())
+        {
+            fprintf(stderr, "No service found for %s\n", path.c_str());
+            done(std::string());
+            return;
+        }
+
+        const auto& service = objects.begin()->first;
+        services[{path, iface}] = service;
+        done(service);
+    };
+    if (!callAsync(bus, method, std::move(onReply)))
+    {
+        done(std::string());
+    }
+}
+
+void resolveServices(
+    sdbusplus::bus::bus& bus,
+    const std::vector<std::pair<std::string, std::string>>& objects)
+{
+    auto pending = std::make_shared<size_t>(0);
+    std::set<std::pair<std::string, std::string>> unique(objects.begin(),
+                                                         objects.end());
+    for (const auto& [path, iface] : unique)
+    {
+        if (services.find({path, iface}) != services.end())
+        {
+            continue;
+        }
+        ++*pending;
+        resolveService(bus, path, iface,
+                       [pending](const std::string&) { --*pending; });
+    }
+    waitReplies(bus, *pending);
+}
+
+std::string findService(const std::string& path, const std::string& iface)
+{
+    auto it = services.find({path, iface});
+    return it != services.end() ? it->second : std::string();
+}
+
+void addService(const std::string& path, const std::string& iface,
+                const std::string& service)
+{
+    services[{path, iface}] = service;
+}
+
+} // namespace hostpwrctl
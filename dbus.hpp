@@ -0,0 +1,318 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#pragma once
+
+#include <sdbusplus/bus.hpp>
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace hostpwrctl
+{
+
+constexpr auto ifaceDBusProperties = "org.freedesktop.DBus.Properties";
+
+/**
+ * @brief D-Bus property descriptor
+ *
+ * @tparam T - property value type
+ */
+template <typename T>
+struct Property
+{
+    using Type = T;
+
+    const char* path;  // object path
+    const char* iface; // D-Bus interface
+    const char* name;  // property name
+};
+
+/**
+ * @brief Handler of the asynchronous method call reply
+ */
+using ReplyHandler = std::function<void(sdbusplus::message::message&)>;
+
+/**
+ * @brief Send D-Bus method call without waiting for the reply,
+ *        the reply is passed to the handler from the bus processing
+ *
+ * @param bus     - D-Bus connection
+ * @param method  - method call message
+ * @param handler - reply handler
+ *
+ * @return false if the method call can not be sent
+ */
+bool callAsync(sdbusplus::bus::bus& bus, sdbusplus::message::message& method,
+               ReplyHandler&& handler);
+
+/**
+ * @brief Check the method reply for an error
+ *
+ * @param reply - method reply
+ * @param what  - request description for the error message
+ *
+ * @return true if the reply is an error
+ */
+bool isReplyError(sdbusplus::message::message& reply, const char* what);
+
+/**
+ * @brief Process the bus until all the expected replies are received
+ *
+ * @param bus     - D-Bus connection
+ * @param pending - number of the replies which are not received yet
+ */
+void waitReplies(sdbusplus::bus::bus& bus, const size_t& pending);
+
+/**
+ * @brief Resolve D-Bus service name with the object mapper.
+ *        The resolved names are cached, so the mapper is asked only once
+ *        for each object.
+ *
+ * @param bus   - D-Bus connection
+ * @param path  - object path
+ * @param iface - D-Bus interface
+ * @param done  - completion handler, the argument is the service name or
+ *                empty string on error
+ */
+void resolveService(sdbusplus::bus::bus& bus, const std::string& path,
+                    const std::string& iface,
+                    std::function<void(const std::string&)>&& done);
+
+/**
+ * @brief Resolve D-Bus service names of the objects with the object mapper,
+ *        the requests for all the objects are sent at once
+ *
+ * @param bus     - D-Bus connection
+ * @param objects - pairs of object path and D-Bus interface
+ */
+void resolveServices(
+    sdbusplus::bus::bus& bus,
+    const std::vector<std::pair<std::string, std::string>>& objects);
+
+/**
+ * @brief Get D-Bus service name resolved before
+ *
+ * @param path  - object path
+ * @param iface - D-Bus interface
+ *
+ * @return D-Bus service name or empty string if not resolved
+ */
+std::string findService(const std::string& path, const std::string& iface);
+
+/**
+ * @brief Store the known D-Bus service name of the object,
+ *        so the object mapper is not asked for it
+ *
+ * @param path    - object path
+ * @param iface   - D-Bus interface
+ * @param service - D-Bus service name
+ */
+void addService(const std::string& path, const std::string& iface,
+                const std::string& service);
+
+/**
+ * @brief Send the Get request of the property, the received value is
+ *        stored in the shared storage
+ *
+ * @param bus     - D-Bus connection
+ * @param prop    - property descriptor
+ * @param value   - storage for the property value
+ * @param pending - counter of the requests in flight
+ */
+template <typename T>
+void requestProperty(sdbusplus::bus::bus& bus, const Property<T>& prop,
+                     std::shared_ptr<std::optional<T>> value,
+                     std::shared_ptr<size_t> pending)
+{
+    auto service = findService(prop.path, prop.iface);
+    if (service.empty())
+    {
+        return;
+    }
+
+    auto method = bus.new_method_call(service.c_str(), prop.path,
+                                      ifaceDBusProperties, "Get");
+    method.append(prop.iface, prop.name);
+
+    auto onReply = [value, pending](sdbusplus::message::message& reply) {
+        --*pending;
+        if (!isReplyError(reply, "get property request"))
+        {
+            std::variant<T> data;
+            reply.read(data);
+            *value = std::move(std::get<T>(data));
+        }
+    };
+    if (callAsync(bus, method, std::move(onReply)))
+    {
+        ++*pending;
+    }
+}
+
+/**
+ * @brief Get D-Bus property asynchronously.
+ *        The service name is resolved with the object mapper unless it is
+ *        already known, the replies are handled from the bus processing.
+ *
+ * @param bus  - D-Bus connection
+ * @param prop - property descriptor
+ * @param done - completion handler, the argument is empty on error
+ */
+template <typename T>
+void readProperty(
+    sdbusplus::bus::bus& bus, const Property<T>& prop,
+    std::function<void(std::optional<typename Property<T>::Type>)> done)
+{
+    // The descriptor may refer to the caller's strings, which are gone by
+    // the time the mapper replies
+    auto sendGet = [&bus, path = std::string(prop.path),
+                    iface = std::string(prop.iface),
+                    name = std::string(prop.name),
+                    done](const std::string& service) {
+        auto method = bus.new_method_call(service.c_str(), path.c_str(),
+                                          ifaceDBusProperties, "Get");
+        method.append(iface, name);
+
+        auto onGet = [done](sdbusplus::message::message& reply) {
+            std::optional<T> value;
+            if (!isReplyError(reply, "get property request"))
+            {
+                std::variant<T> data;
+                reply.read(data);
+                value = std::move(std::get<T>(data));
+            }
+            done(std::move(value));
+        };
+        if (!callAsync(bus, method, std::move(onGet)))
+        {
+            done(std::nullopt);
+        }
+    };
+
+    resolveService(bus, prop.path, prop.iface,
+                   [sendGet, done](const std::string& service) {
+                       if (service.empty())
+                       {
+                           done(std::nullopt);
+                           return;
+                       }
+                       sendGet(service);
+                   });
+}
+
+/**
+ * @brief Get D-Bus property values.
+ *        All the mapper requests and then all the Get requests are sent
+ *        at once, so the batch costs two round trips regardless of the
+ *        number of properties.
+ *
+ * @param bus   - D-Bus connection
+ * @param props - property descriptors
+ *
+ * @return property values, empty if the value is not available
+ */
+template <typename... T>
+std::tuple<std::optional<T>...> getProperties(sdbusplus::bus::bus& bus,
+                                              const Property<T>&... props)
+{
+    resolveServices(bus, {{props.path, props.iface}...});
+
+    auto pending = std::make_shared<size_t>(0);
+    std::tuple<std::shared_ptr<std::optional<T>>...> values{
+        std::make_shared<std::optional<T>>()...};
+    std::apply(
+        [&](auto&... value) {
+            (requestProperty(bus, props, value, pending), ...);
+        },
+        values);
+    waitReplies(bus, *pending);
+
+    return std::apply(
+        [](auto&... value) { return std::make_tuple(std::move(*value)...); },
+        values);
+}
+
+/**
+ * @brief Get D-Bus property value
+ *
+ * @param bus  - D-Bus connection
+ * @param prop - property descriptor
+ *
+ * @return property value, empty if the value is not available
+ */
+template <typename T>
+std::optional<T> getProperty(sdbusplus::bus::bus& bus, const Property<T>& prop)
+{
+    return std::get<0>(getProperties(bus, prop));
+}
+
+/**
+ * @brief Set D-Bus property of the known service asynchronously,
+ *        the reply is handled from the bus processing
+ *
+ * @param bus     - D-Bus connection
+ * @param service - D-Bus service name
+ * @param prop    - property descriptor
+ * @param value   - new value
+ * @param done    - completion handler, the argument is false on error
+ */
+template <typename T>
+void setPropertyAt(sdbusplus::bus::bus& bus, const std::string& service,
+                   const Property<T>& prop, const T& value,
+                   std::function<void(bool)> done)
+{
+    auto method = bus.new_method_call(service.c_str(), prop.path,
+                                      ifaceDBusProperties, "Set");
+    method.append(prop.iface, prop.name, std::variant<T>(value));
+
+    auto onSet = [done](sdbusplus::message::message& reply) {
+        done(!isReplyError(reply, "set property request"));
+    };
+    if (!callAsync(bus, method, std::move(onSet)))
+    {
+        done(false);
+    }
+}
+
+/**
+ * @brief Set D-Bus property asynchronously.
+ *        The service name is resolved with the object mapper unless it is
+ *        already known, the replies are handled from the bus processing.
+ *
+ * @param bus   - D-Bus connection
+ * @param prop  - property descriptor
+ * @param value - new value
+ * @param done  - completion handler, the argument is false on error
+ */
+template <typename T>
+void setProperty(sdbusplus::bus::bus& bus, const Property<T>& prop, T value,
+                 std::function<void(bool)> done)
+{
+    // The descriptor may refer to the caller's strings, which are gone by
+    // the time the mapper replies
+    resolveService(bus, prop.path, prop.iface,
+                   [&bus, path = std::string(prop.path),
+                    iface = std::string(prop.iface),
+                    name = std::string(prop.name), value = std::move(value),
+                    done](const std::string& service) {
+                       if (service.empty())
+                       {
+                           done(false);
+                           return;
+                       }
+                       Property<T> owned{path.c_str(), iface.c_str(),
+                                         name.c_str()};
+                       setPropertyAt(bus, service, owned, value, done);
+                   });
+}
+
+} // namespace hostpwrctl
@@ -0,0 +1,101 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#include "hangdetector.hpp"
+
+#include "state.hpp"
+
+#include <algorithm>
+
+namespace hostpwrctl
+{
+
+/** @brief Host states which are expected to be left soon */
+static const char* const transitionalStates[] = {
+    "TransitioningToRunning",
+    "TransitioningToOff",
+    "Quiesced",
+};
+
+/** @brief Weight of the new duration in the learned average, 1/N */
+constexpr unsigned learningWeight = 4;
+
+HangDetector::HangDetector(const sdeventplus::Event& event,
+                           const std::string& path, Callback&& done) :
+    path(path),
+    learned(BootProfile::loadBaseline(path)), onHang(std::move(done)),
+    timer(event, [this](Timer&) {
+        hung = true;
+        onHang(state, Clock::now() - entered);
+    })
+{}
+
+void HangDetector::update(const std::string& host)
+{
+    if (host == state)
+    {
+        return;
+    }
+
+    auto now = Clock::now();
+    auto name = trimClassName(state);
+    if (!initial && !hung && !state.empty() &&
+        std::find(std::begin(transitionalStates), std::end(transitionalStates),
+                  name) != std::end(transitionalStates))
+    {
+        learn(name, now - entered);
+    }
+
+    initial = state.empty();
+    state = host;
+    entered = now;
+    hung = false;
+
+    name = trimClassName(state);
+    if (std::find(std::begin(transitionalStates), std::end(transitionalStates),
+                  name) != std::end(transitionalStates))
+    {
+        timer.restartOnce(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                threshold(name)));
+    }
+    else
+    {
+        timer.setEnabled(false);
+    }
+}
+
+void HangDetector::learn(const std::string& name, Clock::duration duration)
+{
+    auto it = std::find_if(
+        learned.begin(), learned.end(),
+        [&name](const auto& item) { return item.first == name; });
+    if (it == learned.end())
+    {
+        learned.emplace_back(name, duration);
+    }
+    else
+    {
+        // Moving average, a single slow transition does not spoil it
+        it->second =
+            (it->second * (learningWeight - 1) + duration) / learningWeight;
+    }
+    BootProfile::saveDurations(path, learned);
+}
+
+HangDetector::Clock::duration
+    HangDetector::threshold(const std::string& name) const
+{
+    auto it = std::find_if(
+        learned.begin(), learned.end(),
+        [&name](const auto& item) { return item.first == name; });
+    if (it == learned.end())
+    {
+        return defaultThreshold;
+    }
+    return std::max<Clock::duration>(it->second * factor, minThreshold);
+}
+
+} // namespace hostpwrctl
@@ -0,0 +1,100 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#pragma once
+
+#include "bootprofile.hpp"
+
+#include <sdeventplus/clock.hpp>
+#include <sdeventplus/event.hpp>
+#include <sdeventplus/utility/timer.hpp>
+
+#include <chrono>
+#include <functional>
+#include <string>
+
+namespace hostpwrctl
+{
+
+/**
+ * @brief Detector of the host stuck in the transitional state.
+ *
+ *        The time spent in TransitioningToRunning, TransitioningToOff and
+ *        Quiesced is learned from the normal transitions and saved to the
+ *        file in the boot baseline format, so the learning survives the
+ *        restarts. The host is reported as hung once the state lasts longer
+ *        than the learned duration multiplied by the factor.
+ */
+class HangDetector
+{
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Hang handler, the arguments are the host state and the time
+     *        spent in it
+     */
+    using Callback = std::function<void(const std::string&, Clock::duration)>;
+
+    /** @brief Allowed slowdown of the transition compared to the learned */
+    static constexpr unsigned factor = 3;
+
+    /** @brief Minimal hang threshold, shorter stalls are not reported */
+    static constexpr auto minThreshold = std::chrono::seconds(60);
+
+    /** @brief Hang threshold of the state which is not learned yet */
+    static constexpr auto defaultThreshold = std::chrono::seconds(600);
+
+    /**
+     * @brief Constructor, loads the learned durations
+     *
+     * @param event - event loop
+     * @param path  - learned durations file path
+     * @param done  - hang handler
+     */
+    HangDetector(const sdeventplus::Event& event, const std::string& path,
+                 Callback&& done);
+
+    HangDetector(const HangDetector&) = delete;
+    HangDetector& operator=(const HangDetector&) = delete;
+
+    /**
+     * @brief Handle the host state.
+     *        The state seen first is not learned, its start time is unknown.
+     *
+     * @param host - current host state
+     */
+    void update(const std::string& host);
+
+  private:
+    using Timer = sdeventplus::utility::Timer<sdeventplus::ClockId::Monotonic>;
+
+    /**
+     * @brief Learn the duration of the normally left state
+     *
+     * @param name     - state name without the class name
+     * @param duration - time spent in the state
+     */
+    void learn(const std::string& name, Clock::duration duration);
+
+    /**
+     * @brief Get the hang threshold of the state
+     *
+     * @param name - state name without the class name
+     */
+    Clock::duration threshold(const std::string& name) const;
+
+    std::string path;
+    BootProfile::Durations learned;
+    Callback onHang;
+    Timer timer;
+
+    std::string state;         // current state
+    Clock::time_point entered; // time of the current state start
+    bool initial = true;       // the current state is the first one seen
+    bool hung = false;         // the hang of the current state is reported
+};
+
+} // namespace hostpwrctl
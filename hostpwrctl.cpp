@@ -3,319 +3,832 @@
  * Copyright (C) 2021 YADRO.
  */
 
+#include "auditlog.hpp"
+#include "bootprofile.hpp"
+#include "coroutine.hpp"
+#include "dbus.hpp"
+#include "hangdetector.hpp"
+#include "journal.hpp"
+#include "powercontrol.hpp"
+#include "realtime.hpp"
+#include "recorder.hpp"
+#include "sequencer.hpp"
+#include "shutdown.hpp"
+#include "state.hpp"
+#include "statecache.hpp"
+#include "trace.hpp"
+#include "util.hpp"
+
+#include <getopt.h>
+#include <pwd.h>
+#include <signal.h>
+#include <unistd.h>
+
 #include <sdbusplus/bus.hpp>
-#include <sdbusplus/bus/match.hpp>
 #include <sdbusplus/exception.hpp>
 #include <sdeventplus/clock.hpp>
 #include <sdeventplus/event.hpp>
 #include <sdeventplus/exception.hpp>
 #include <sdeventplus/source/event.hpp>
+#include <sdeventplus/source/signal.hpp>
 #include <sdeventplus/utility/timer.hpp>
 
+#include <cerrno>
+#include <chrono>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace hostpwrctl;
 
-constexpr auto clockId = sdeventplus::ClockId::RealTime;
+constexpr auto clockId = sdeventplus::ClockId::Monotonic;
 using Timer = sdeventplus::utility::Timer<clockId>;
-constexpr auto confirmationTime = 30;
+static unsigned confirmationTime = 30;
+static unsigned stallTime = 0;
+static unsigned minOffTime = 5;
+
+constexpr auto baselineDir = "/var/lib/hostpwrctl";
+constexpr unsigned defaultTolerance = 20;
+constexpr int exitRegression = 3;
+constexpr unsigned defaultMargin = 10;
 
 static sdbusplus::bus::bus systemBus = sdbusplus::bus::new_default();
 static sdeventplus::Event systemEvent = sdeventplus::Event::get_default();
 
-constexpr auto chassisPath = "/xyz/openbmc_project/state/chassis0";
-constexpr auto chassisIface = "xyz.openbmc_project.State.Chassis";
-constexpr auto chassisState = "CurrentPowerState";
-constexpr auto chassisStateOn =
-    "xyz.openbmc_project.State.Chassis.PowerState.On";
-constexpr auto chassisStateOff =
-    "xyz.openbmc_project.State.Chassis.PowerState.Off";
-constexpr auto chassisTransition = "RequestedPowerTransition";
-constexpr auto chassisTransitionOff =
-    "xyz.openbmc_project.State.Chassis.Transition.Off";
+static StateCache stateCache;
+
+static std::string waitChassisState, waitHostState;
+
+// States shown to the user
+static std::string shownChassisState, shownHostState;
 
-constexpr auto hostPath = "/xyz/openbmc_project/state/host0";
-constexpr auto hostIface = "xyz.openbmc_project.State.Host";
-constexpr auto hostState = "CurrentHostState";
-constexpr auto hostStateOn = "xyz.openbmc_project.State.Host.HostState.Running";
-constexpr auto hostStateOff = "xyz.openbmc_project.State.Host.HostState.Off";
-constexpr auto hostTransition = "RequestedHostTransition";
-constexpr auto hostTransitionOn =
-    "xyz.openbmc_project.State.Host.Transition.On";
-constexpr auto hostTransitionOff =
-    "xyz.openbmc_project.State.Host.Transition.Off";
-constexpr auto hostTransitionReboot =
-    "xyz.openbmc_project.State.Host.Transition.Reboot";
+// Audit record of the invocation, empty if the command is not audited
+static std::optional<AuditEntry> audit;
+static std::chrono::steady_clock::time_point auditStart;
+static const char* auditFile = auditLogPath;
 
-constexpr auto ifaceDBusProperties = "org.freedesktop.DBus.Properties";
+// Detector of the host hang in the publish mode and its hook command
+static std::optional<HangDetector> hangDetector;
+static const char* hangHook = nullptr;
 
-static std::string currentChassisState, expectedChassisState;
-static std::string currentHostState, expectedHostState;
+// Boot override sent along with the host start
+static std::optional<PowerControl::BootOverride> bootOverride;
+
+// The request of another process is joined, its profile starts in the middle
+static bool requestJoined = false;
+
+// Short names of the boot sources and modes
+static const std::vector<const char*> bootSources = {
+    "Disk", "Network", "ExternalMedia", "RemovableMedia", "HTTP", "Default"};
+static const std::vector<const char*> bootModes = {"Regular", "Safe",
+                                                   "Setup"};
 
 /**
- * @brief Remove class name form the property value
- *        For example 'xyz.foo.bar.value' -> 'value'
+ * @brief Parse the short name of the D-Bus enumeration value
  *
- * @param value - Original value
+ * @param arg    - argument string, e.g. 'Network'
+ * @param known  - known short names
+ * @param prefix - enumeration class name
+ * @param value  - full D-Bus value
  *
- * @return trimmed value
+ * @return false if the name is unknown
  */
-inline std::string trimClassName(const std::string& value)
+inline bool parseEnumValue(const char* arg,
+                           const std::vector<const char*>& known,
+                           const char* prefix, std::string& value)
 {
-    auto last = value.rfind('.');
-    if (last && last != std::string::npos)
+    for (const auto name : known)
     {
-        return value.substr(last + 1);
+        if (0 == strcmp(arg, name))
+        {
+            value = std::string(prefix) + name;
+            return true;
+        }
     }
-    return value;
+    return false;
 }
 
 /**
- * @brief Get D-Bus service name
+ * @brief Format the time stamp
  *
- * @param path  - object path
- * @param iface - D-Bus interface
+ * @param ms - milliseconds since the epoch
  *
- * @return D-Bus service name
+ * @return local time string
  */
-static std::string getService(const std::string& path, const std::string& iface)
+inline std::string formatTime(uint64_t ms)
 {
-    auto method = systemBus.new_method_call(
-        "xyz.openbmc_project.ObjectMapper",
-        "/xyz/openbmc_project/object_mapper",
-        "xyz.openbmc_project.ObjectMapper", "GetObject");
-
-    std::vector<std::string> ifaces = {iface};
-    method.append(path, ifaces);
+    time_t sec = static_cast<time_t>(ms / 1000);
+    struct tm tm;
+    char buf[32];
+    if (!localtime_r(&sec, &tm) ||
+        !strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm))
+    {
+        return std::to_string(ms);
+    }
+    return buf;
+}
 
-    std::map<std::string, std::vector<std::string>> services;
-    try
+/**
+ * @brief Add class name to the property value if it is omitted
+ *        For example 'value' -> 'xyz.foo.bar.value'
+ *
+ * @param prefix - class name with the trailing dot
+ * @param value  - original value
+ *
+ * @return full value
+ */
+inline std::string addClassName(const char* prefix, const std::string& value)
+{
+    if (value.find('.') == std::string::npos)
     {
-        systemBus.call(method).read(services);
+        return prefix + value;
     }
-    catch (const sdbusplus::exception::SdBusError& e)
+    return value;
+}
+
+/**
+ * @brief Get the time since the process start, the resolution is the clock
+ *        tick of the process accounting
+ *
+ * @return elapsed time, 0 if the start time is not available
+ */
+std::chrono::microseconds sinceProcessStart()
+{
+    timespec now;
+    clock_gettime(CLOCK_BOOTTIME, &now);
+
+    FILE* stat = fopen("/proc/self/stat", "r");
+    if (!stat)
     {
-        fprintf(stderr, "Error occurred during the object mapper call: %s\n",
-                e.what());
+        return {};
     }
+    char buf[512];
+    size_t size = fread(buf, 1, sizeof(buf) - 1, stat);
+    fclose(stat);
+    buf[size] = 0;
 
-    if (!services.empty())
+    // The start time is the 22nd field, the command name may have spaces
+    const char* field = strrchr(buf, ')');
+    for (int i = 0; field && i < 20; ++i)
     {
-        return std::move(services.begin()->first);
+        field = strchr(field + 1, ' ');
     }
+    if (!field)
+    {
+        return {};
+    }
+    unsigned long long ticks = strtoull(field + 1, nullptr, 10);
+    unsigned long long start = ticks * 1000000 / sysconf(_SC_CLK_TCK);
+    unsigned long long current =
+        static_cast<unsigned long long>(now.tv_sec) * 1000000 +
+        now.tv_nsec / 1000;
 
-    return std::string();
+    return std::chrono::microseconds(current > start ? current - start : 0);
 }
 
 /**
- * @brief Get D-Bus property value
+ * @brief Start the audit record of the invocation
  *
- * @param path     - object path
- * @param iface    - D-Bus interface
- * @param property - property name
+ * @param argc - number of the arguments
+ * @param argv - arguments
+ */
+void startAudit(int argc, char* argv[])
+{
+    audit.emplace();
+    for (int i = 1; i < argc; ++i)
+    {
+        if (i > 1)
+        {
+            audit->command += ' ';
+        }
+        audit->command += argv[i];
+    }
+    audit->uid = getuid();
+    audit->pid = getpid();
+    audit->start = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch())
+            .count());
+    auditStart = std::chrono::steady_clock::now();
+}
+
+/**
+ * @brief Add the power state seen to the audit record
  *
- * @return property value
+ * @param state - chassis or host state
  */
-std::string getProperty(const std::string& path, const std::string& iface,
-                        const std::string& property)
+void auditState(const std::string& state)
 {
-    auto service = getService(path, iface);
-    if (service.empty())
+    if (audit && !state.empty())
     {
-        return std::string();
+        audit->states.push_back(encodeAuditState(state));
     }
+}
 
-    auto method = systemBus.new_method_call(service.c_str(), path.c_str(),
-                                            ifaceDBusProperties, "Get");
-    method.append(iface, property);
+/**
+ * @brief Append the audit record of the invocation to the audit log
+ *
+ * @param rc - exit code
+ *
+ * @return exit code
+ */
+int finishAudit(int rc)
+{
+    if (audit)
+    {
+        audit->result = rc;
+        audit->duration = static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - auditStart)
+                .count());
+        // The audit failure does not change the operation result
+        appendAuditEntry(auditFile, *audit);
+        audit.reset();
+    }
+    return rc;
+}
 
-    try
+/**
+ * @brief Show the changed states
+ *
+ * @param chassis - current chassis state
+ * @param host    - current host state
+ */
+void showStateChange(const std::string& chassis, const std::string& host)
+{
+    if (chassis != shownChassisState)
+    {
+        shownChassisState = chassis;
+        printf("Current Chassis State: %s\n", trimClassName(chassis).c_str());
+        auditState(chassis);
+    }
+    if (host != shownHostState)
     {
-        std::variant<std::string> data;
-        systemBus.call(method).read(data);
-        return std::move(std::get<std::string>(data));
+        shownHostState = host;
+        printf("Current Host State: %s\n", trimClassName(host).c_str());
+        auditState(host);
     }
-    catch (const sdbusplus::exception::SdBusError& e)
+    if (hangDetector)
     {
-        fprintf(stderr, "Error occurred during get property request, %s\n",
-                e.what());
+        hangDetector->update(host);
     }
 
-    return "";
+    stateCache.update(chassis, host);
 }
 
 /**
- * @brief Set D-Bus property
+ * @brief Terminate the event loop when the operation is completed
  *
- * @param path     - object path
- * @param iface    - D-Bus interface
- * @param property - property name
- * @param value    - new value
+ * @param result - operation result
  */
-void setProperty(const std::string& path, const std::string& iface,
-                 const std::string& property, const std::string& value)
+void onOperationDone(PowerControl::Result result)
 {
-    auto service = getService(path, iface);
-    if (service.empty())
+    switch (result)
     {
-        return;
+        case PowerControl::Result::success:
+            systemEvent.exit(EXIT_SUCCESS);
+            break;
+        case PowerControl::Result::timeout:
+            if (stallTime)
+            {
+                printf("Unable to confirm operation success within timeout "
+                       "period (%u s) or no progress for %u s.\n",
+                       confirmationTime, stallTime);
+            }
+            else
+            {
+                printf("Unable to confirm operation success "
+                       "within timeout period (%u s).\n",
+                       confirmationTime);
+            }
+            systemEvent.exit(EXIT_FAILURE);
+            break;
+        case PowerControl::Result::failure:
+            systemEvent.exit(EXIT_FAILURE);
+            break;
     }
+}
 
-    auto method = systemBus.new_method_call(service.c_str(), path.c_str(),
-                                            ifaceDBusProperties, "Set");
-    std::variant<std::string> data(value);
-    method.append(iface, property, data);
+/**
+ * @brief Report the conflicting request of another process
+ *
+ * @param power - power control
+ */
+void showConflict(const PowerControl& power)
+{
+    const auto& request = power.getSharedRequest();
+    fprintf(stderr, "Conflicting request '%s' is in progress (PID %d).\n",
+            request.getOperation().c_str(), request.getOwner());
+}
 
-    try
-    {
-        systemBus.call(method);
-    }
-    catch (const sdbusplus::exception::SdBusError& e)
+/**
+ * @brief Start the power operation and report how it is started
+ *
+ * @param power     - power control
+ * @param operation - power operation
+ * @param sent      - message shown when the request is sent
+ * @param skipped   - message shown when the request is needless
+ */
+void startOperation(PowerControl& power, PowerControl::Operation operation,
+                    const char* sent, const char* skipped)
+{
+    const auto& request = power.getSharedRequest();
+    switch (power.request(operation, onOperationDone))
     {
-        fprintf(stderr, "Error occurred during set property request, %s\n",
-                e.what());
+        case PowerControl::Status::sent:
+            if (request.getReplacedOwner())
+            {
+                printf("Request of PID %d is replaced.\n",
+                       request.getReplacedOwner());
+            }
+            printf("%s\n", sent);
+            break;
+        case PowerControl::Status::joined:
+            printf("The same request is in progress (PID %d), joining it.\n",
+                   request.getOwner());
+            requestJoined = true;
+            break;
+        case PowerControl::Status::skipped:
+            printf("%s\n", skipped);
+            if (bootOverride)
+            {
+                printf("The boot override is not applied.\n");
+            }
+            systemEvent.exit(EXIT_SUCCESS);
+            break;
+        case PowerControl::Status::conflict:
+            showConflict(power);
+            systemEvent.exit(EXIT_FAILURE);
+            break;
+        case PowerControl::Status::failed:
+        case PowerControl::Status::busy:
+            systemEvent.exit(EXIT_FAILURE);
+            break;
     }
 }
 
 /**
- * @brief Terminate the event loop if expected values reached
+ * @brief Send the power on command
  */
-void exitOnExpectedState()
+void switchHostPowerOn(PowerControl& power)
 {
-    if (!expectedHostState.empty() && !expectedChassisState.empty() &&
-        expectedHostState == currentHostState &&
-        expectedChassisState == currentChassisState)
+    startOperation(power, PowerControl::Operation::on,
+                   "Power up signal was sent to host, waiting for system "
+                   "start.",
+                   "System is already up.");
+}
+
+/**
+ * @brief Send the gracefully shut down command
+ */
+void switchHostPowerOff(PowerControl& power)
+{
+    startOperation(power, PowerControl::Operation::soft,
+                   "Shutdown signal was sent to host, waiting for system "
+                   "down.",
+                   "System is already down.");
+}
+
+/**
+ * @brief Send the forced shut down command
+ */
+void switchChassisPowerOff(PowerControl& power)
+{
+    startOperation(power, PowerControl::Operation::off,
+                   "Shutdown signal was sent to chassis, waiting for system "
+                   "down.",
+                   "System is already down.");
+}
+
+/**
+ * @brief Wait for the forced shut down requested on the emergency path
+ */
+void followEmergencyOff(PowerControl& power)
+{
+    printf("Emergency shutdown signal was sent to chassis, waiting for "
+           "system down.\n");
+    power.follow(PowerControl::Operation::off, onOperationDone);
+    if (power.getSharedRequest().getReplacedOwner())
     {
-        systemEvent.exit(EXIT_SUCCESS);
+        printf("Request of PID %d is replaced.\n",
+               power.getSharedRequest().getReplacedOwner());
     }
 }
 
 /**
- * @brief PropertiesChanged signal handler
+ * @brief Send the forced shut down request right after the start
  *
- * @param m - signal data
+ * @param service - chassis manager service name, empty for the well-known
+ *                  name
  */
-void onPropertiesChanged(sdbusplus::message::message& m)
+void sendEmergencyOff(const char* service)
 {
-    std::string iface;
-    std::map<std::string, std::variant<std::string>> data;
-    std::vector<std::string> v;
+    requestEmergencyOff(systemBus, 0, service, [](bool success) {
+        if (!success)
+        {
+            systemEvent.exit(EXIT_FAILURE);
+            return;
+        }
+        auto accepted = sinceProcessStart();
+        printf("Emergency shutdown request accepted in %llu.%03llu ms "
+               "after the start.\n",
+               static_cast<unsigned long long>(accepted.count() / 1000),
+               static_cast<unsigned long long>(accepted.count() % 1000));
+    });
+
+    auto sent = sinceProcessStart();
+    flightRecorder().record(FlightRecorder::Event::note,
+                            "emergency off sent in %llu us",
+                            static_cast<unsigned long long>(sent.count()));
+    printf("Emergency shutdown request sent in %llu.%03llu ms after the "
+           "start.\n",
+           static_cast<unsigned long long>(sent.count() / 1000),
+           static_cast<unsigned long long>(sent.count() % 1000));
+}
+
+/**
+ * @brief Reset the host power
+ */
+void resetHostPower(PowerControl& power)
+{
+    startOperation(power, PowerControl::Operation::reboot,
+                   "Reboot signal was sent to host, waiting for system down "
+                   "and start again.",
+                   "Chassis is off, reboot is impossible.");
+}
+
+/**
+ * @brief Restart the host keeping the chassis power on
+ */
+void warmRebootHost(PowerControl& power)
+{
+    startOperation(power, PowerControl::Operation::warmReboot,
+                   "Warm reboot signal was sent to host, waiting for system "
+                   "start again.",
+                   "Chassis is off, reboot is impossible.");
+}
 
-    m.read(iface, data, v);
+/**
+ * @brief Restart the host immediately keeping the chassis power on
+ */
+void forceWarmRebootHost(PowerControl& power)
+{
+    startOperation(power, PowerControl::Operation::forceWarmReboot,
+                   "Forced warm reboot signal was sent to host, waiting for "
+                   "system start again.",
+                   "Chassis is off, reboot is impossible.");
+}
 
-    if (iface == chassisIface)
+/**
+ * @brief Show the duration of the operation step
+ *
+ * @param step     - step name
+ * @param duration - step duration
+ */
+void showStepTime(const char* step,
+                  std::chrono::steady_clock::duration duration)
+{
+    auto ms =
+        std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+    printf("%s: %lld.%03lld s\n", step, static_cast<long long>(ms / 1000),
+           static_cast<long long>(ms % 1000));
+}
+
+/**
+ * @brief Cycle the chassis power with the PowerCycle transition or,
+ *        if the chassis manager rejects it, with the power off and on keeping
+ *        the power off for the minimal time
+ *
+ * @param power - power control
+ */
+Task<> cyclePower(PowerControl& power)
+{
+    using Clock = std::chrono::steady_clock;
+    using Operation = PowerControl::Operation;
+    using Result = PowerControl::Result;
+
+    if (power.getChassisState() == chassisStateOff)
     {
-        auto it = data.find(chassisState);
-        if (it != data.end())
-        {
-            currentChassisState = std::get<std::string>(it->second);
-            printf("Current Chassis State: %s\n",
-                   trimClassName(currentChassisState).c_str());
-            exitOnExpectedState();
-        }
+        printf("Chassis is off, power cycle is impossible.\n");
+        systemEvent.exit(EXIT_SUCCESS);
+        co_return;
     }
-    else if (iface == hostIface)
+
+    printf("Power cycle signal was sent to chassis, waiting for system down "
+           "and start again.\n");
+    auto started = Clock::now();
+    auto cycle = power.run(Operation::powerCycle);
+    auto result = co_await cycle;
+    if (cycle.getStatus() == PowerControl::Status::conflict)
+    {
+        // Neither the fallback power off may override the other request
+        showConflict(power);
+        systemEvent.exit(EXIT_FAILURE);
+        co_return;
+    }
+    // Only the transition rejected by the chassis manager is not supported,
+    // the failure of the joined request is reported as is
+    if (cycle.getStatus() == PowerControl::Status::sent &&
+        result == Result::failure)
     {
-        auto it = data.find(hostState);
-        if (it != data.end())
+        printf("Power cycle is not supported, turning the power off and "
+               "on.\n");
+        auto step = Clock::now();
+        result = co_await power.run(Operation::off);
+        showStepTime("Power off", Clock::now() - step);
+        if (result == Result::success)
         {
-            currentHostState = std::get<std::string>(it->second);
-            printf("Current Host State: %s\n",
-                   trimClassName(currentHostState).c_str());
-            exitOnExpectedState();
+            step = Clock::now();
+            co_await Sleep(systemEvent, std::chrono::seconds(minOffTime));
+            showStepTime("Power off hold", Clock::now() - step);
+
+            step = Clock::now();
+            result = co_await power.run(Operation::on);
+            showStepTime("Power on", Clock::now() - step);
         }
     }
+    showStepTime("Power cycle", Clock::now() - started);
+
+    onOperationDone(result);
 }
 
 /**
- * @brief Send the power on command
+ * @brief Cycle the chassis power
  */
-void switchHostPowerOn(sdeventplus::source::EventBase&)
+void cycleHostPower(PowerControl& power)
 {
-    if (currentChassisState != chassisStateOn)
+    spawn(cyclePower(power));
+}
+
+/**
+ * @brief Show actual power state
+ */
+void showPowerStatus(PowerControl& power)
+{
+    auto [chassisChanged, hostChanged, bootProgress, osStatus] =
+        getProperties(systemBus, chassisLastChangeProperty,
+                      hostLastChangeProperty, bootProgressProperty,
+                      osStatusProperty);
+
+    printf("Current Chassis state: %s\n",
+           trimClassName(power.getChassisState()).c_str());
+    if (chassisChanged)
     {
-        expectedHostState = hostStateOn;
-        expectedChassisState = chassisStateOn;
-        setProperty(hostPath, hostIface, hostTransition, hostTransitionOn);
-        printf("Power up signal was sent to host, waiting for system start.\n");
+        printf("Chassis state changed: %s\n",
+               formatTime(*chassisChanged).c_str());
     }
-    else
+    printf("Current Host state: %s\n",
+           trimClassName(power.getHostState()).c_str());
+    if (hostChanged)
     {
-        printf("System is already up.\n");
-        systemEvent.exit(EXIT_SUCCESS);
+        printf("Host state changed: %s\n", formatTime(*hostChanged).c_str());
     }
+    if (bootProgress)
+    {
+        printf("Boot progress: %s\n", trimClassName(*bootProgress).c_str());
+    }
+    if (osStatus)
+    {
+        printf("Operating system state: %s\n",
+               trimClassName(*osStatus).c_str());
+    }
+
+    systemEvent.exit(0);
 }
 
 /**
- * @brief Send the gracefully shut down command
+ * @brief Wait for the requested power state without changing it
  */
-void switchHostPowerOff(sdeventplus::source::EventBase&)
+void waitForPowerState(PowerControl& power)
 {
-    if (currentChassisState != chassisStateOff)
+    printf("Waiting for");
+    if (!waitHostState.empty())
     {
-        expectedHostState = hostStateOff;
-        expectedChassisState = chassisStateOff;
-        setProperty(hostPath, hostIface, hostTransition, hostTransitionOff);
-        printf("Shutdown signal was sent to host, waiting for system down.\n");
+        printf(" Host state %s", trimClassName(waitHostState).c_str());
     }
-    else
+    if (!waitChassisState.empty())
     {
-        printf("System is already down.\n");
-        systemEvent.exit(EXIT_SUCCESS);
+        printf("%s Chassis state %s", waitHostState.empty() ? "" : " and",
+               trimClassName(waitChassisState).c_str());
     }
+    printf(".\n");
+
+    power.wait(waitHostState, waitChassisState, onOperationDone);
 }
 
 /**
- * @brief Send the forced shut down command
+ * @brief Show power state from the snapshot file without D-Bus requests
+ *
+ * @param path - snapshot file path
+ *
+ * @return exit code
  */
-void switchChassisPowerOff(sdeventplus::source::EventBase&)
+int showCachedPowerStatus(const char* path)
 {
-    if (currentChassisState != chassisStateOff)
+    StateCache cache;
+    CachedState state;
+    if (!cache.open(path))
     {
-        expectedHostState = hostStateOff;
-        expectedChassisState = chassisStateOff;
-        setProperty(chassisPath, chassisIface, chassisTransition,
-                    chassisTransitionOff);
-        printf(
-            "Shutdown signal was sent to chassis, waiting for system down.\n");
+        return EXIT_FAILURE;
     }
-    else
+    if (!cache.read(state))
     {
-        printf("System is already down.\n");
-        systemEvent.exit(EXIT_SUCCESS);
+        fprintf(stderr, "State snapshot is not available\n");
+        return EXIT_FAILURE;
     }
+
+    printf("Current Chassis state: %s\n",
+           trimClassName(state.chassisState).c_str());
+    printf("Current Host state: %s\n", trimClassName(state.hostState).c_str());
+    printf("Updated: %llu.%03llu s ago%s\n",
+           static_cast<unsigned long long>(state.age / 1000000),
+           static_cast<unsigned long long>(state.age % 1000000 / 1000),
+           kill(state.publisher, 0) == 0 || errno == EPERM
+               ? ""
+               : " (publisher is not running)");
+
+    return EXIT_SUCCESS;
 }
 
 /**
- * @brief Reset the host power
+ * @brief Report the host hang to the journal and run the hook command
+ *
+ * @param state    - host state
+ * @param duration - time spent in the state
  */
-void resetHostPower(sdeventplus::source::EventBase&)
+void onHostHang(const std::string& state,
+                HangDetector::Clock::duration duration)
 {
-    if (currentChassisState != chassisStateOff)
+    auto name = trimClassName(state);
+    auto sec = std::chrono::duration_cast<std::chrono::seconds>(duration);
+    printf("Host is stuck in %s for %lld s.\n", name.c_str(),
+           static_cast<long long>(sec.count()));
+    logEvent({hostName, "publish", name.c_str(), "hang",
+              std::chrono::duration_cast<std::chrono::microseconds>(
+                  duration)});
+
+    if (!hangHook)
     {
-        expectedHostState = hostStateOn;
-        expectedChassisState = chassisStateOn;
-        setProperty(hostPath, hostIface, hostTransition, hostTransitionReboot);
-        printf("Reboot signal was sent to host, waiting for system down and "
-               "start again.\n");
+        return;
     }
-    else
+    pid_t pid = fork();
+    if (pid == -1)
     {
-        printf("Chassis is off, reboot is impossible.\n");
-        systemEvent.exit(EXIT_SUCCESS);
+        fprintf(stderr, "Unable to run the hang hook: %s\n", strerror(errno));
+    }
+    else if (pid == 0)
+    {
+        // Restore the signal handling changed for the event loop
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, nullptr);
+        signal(SIGCHLD, SIG_DFL);
+
+        setenv("HOST", hostName, 1);
+        setenv("HOST_STATE", name.c_str(), 1);
+        setenv("DURATION_SEC", std::to_string(sec.count()).c_str(), 1);
+        execl("/bin/sh", "sh", "-c", hangHook, nullptr);
+        _exit(127);
     }
 }
 
 /**
- * @brief Show actual power state
+ * @brief Publish power state to the snapshot file until terminated
  */
-void showPowerStatus(sdeventplus::source::EventBase& source)
+void publishPowerStatus(PowerControl& power)
 {
+    shownChassisState = power.getChassisState();
+    shownHostState = power.getHostState();
+    stateCache.update(shownChassisState, shownHostState);
+    if (hangDetector)
+    {
+        hangDetector->update(shownHostState);
+    }
     printf("Current Chassis state: %s\n",
-           trimClassName(currentChassisState).c_str());
-    printf("Current Host state: %s\n", trimClassName(currentHostState).c_str());
+           trimClassName(shownChassisState).c_str());
+    printf("Current Host state: %s\n", trimClassName(shownHostState).c_str());
+}
+
+/**
+ * @brief Dump the flight recorder on SIGUSR1
+ *
+ * @return signal event source
+ */
+sdeventplus::source::Signal handleDumpRequest()
+{
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &mask, nullptr);
+
+    return sdeventplus::source::Signal(
+        systemEvent, SIGUSR1,
+        [](sdeventplus::source::Signal&, const struct signalfd_siginfo*) {
+            flightRecorder().dump(stderr);
+        });
+}
+
+/**
+ * @brief Run the power sequence of the dependent objects
+ *
+ * @param path      - dependency graph file path
+ * @param powerOn   - power on if true, off otherwise
+ * @param traceFile - trace file path, null to disable tracing
+ *
+ * @return exit code
+ */
+int runSequence(const char* path, bool powerOn, const char* traceFile)
+{
+    Sequencer sequencer(systemBus, powerOn, [](bool success) {
+        systemEvent.exit(success ? EXIT_SUCCESS : EXIT_FAILURE);
+    });
+    if (!sequencer.load(path))
+    {
+        return EXIT_FAILURE;
+    }
+
+    systemBus.attach_event(systemEvent.get(), SD_EVENT_PRIORITY_NORMAL);
+    auto dumpRequest = handleDumpRequest();
+
+    Timer confirmationTimer(systemEvent, [](Timer&) {
+        printf("Unable to confirm operation success "
+               "within timeout period (%u s).\n",
+               confirmationTime);
+        flightRecorder().record(FlightRecorder::Event::timer, "expired");
+        systemEvent.exit(EXIT_FAILURE);
+    });
+    sdeventplus::source::Defer defer(
+        systemEvent,
+        [&sequencer, &confirmationTimer](sdeventplus::source::EventBase&) {
+            if (confirmationTime)
+            {
+                confirmationTimer.restartOnce(
+                    std::chrono::seconds(confirmationTime));
+            }
+            sequencer.start();
+        });
 
-    source.get_event().exit(0);
+    int rc = systemEvent.loop();
+    sequencer.report(stdout);
+    if (traceFile && !tracer().write(traceFile))
+    {
+        rc = EXIT_FAILURE;
+    }
+    if (rc != EXIT_SUCCESS)
+    {
+        flightRecorder().dump(stderr);
+    }
+
+    return rc;
 }
 
+/**
+ * @brief Turn off all the hosts within the confirmation timeout
+ *
+ * @param margin    - time reserved for the forced power off, s
+ * @param traceFile - trace file path, null to disable tracing
+ *
+ * @return exit code
+ */
+int runRackShutdown(unsigned margin, const char* traceFile)
+{
+    RackShutdown shutdown(systemBus, systemEvent,
+                          std::chrono::seconds(confirmationTime),
+                          std::chrono::seconds(margin), [](bool success) {
+                              systemEvent.exit(success ? EXIT_SUCCESS
+                                                       : EXIT_FAILURE);
+                          });
+
+    systemBus.attach_event(systemEvent.get(), SD_EVENT_PRIORITY_NORMAL);
+    auto dumpRequest = handleDumpRequest();
+
+    printf("Shutting down all the hosts within %u s, forced power off "
+           "%u s before the deadline.\n",
+           confirmationTime, margin);
+    shutdown.start();
+
+    int rc = systemEvent.loop();
+    shutdown.report(stdout);
+    if (traceFile && !tracer().write(traceFile))
+    {
+        rc = EXIT_FAILURE;
+    }
+    if (rc != EXIT_SUCCESS)
+    {
+        flightRecorder().dump(stderr);
+    }
+
+    return rc;
+}
+
+/** @brief Command action */
+using Action = void (*)(PowerControl&);
+
 /**
  * @brief Convert the command name to the action
  *
@@ -323,7 +836,7 @@ void showPowerStatus(sdeventplus::source::EventBase& source)
  *
  * @return function to execute
  */
-sdeventplus::source::EventBase::Callback getAction(const char* command)
+Action getAction(const char* command)
 {
     if (0 == strcmp(command, "on"))
     {
@@ -341,14 +854,133 @@ sdeventplus::source::EventBase::Callback getAction(const char* command)
     {
         return resetHostPower;
     }
+    if (0 == strcmp(command, "warm-reboot"))
+    {
+        return warmRebootHost;
+    }
+    if (0 == strcmp(command, "force-warm-reboot"))
+    {
+        return forceWarmRebootHost;
+    }
+    if (0 == strcmp(command, "cycle"))
+    {
+        return cycleHostPower;
+    }
     if (0 == strcmp(command, "status"))
     {
         return showPowerStatus;
     }
+    if (0 == strcmp(command, "wait"))
+    {
+        return waitForPowerState;
+    }
+    if (0 == strcmp(command, "publish"))
+    {
+        return publishPowerStatus;
+    }
 
     return nullptr;
 }
 
+/**
+ * @brief Compare the boot phase durations with the stored baseline.
+ *        The measured durations become the baseline if there is no one yet.
+ *
+ * @param profile   - measured boot phases
+ * @param path      - baseline file path
+ * @param tolerance - allowed deviation, percent
+ * @param update    - replace the baseline with the measured durations
+ *
+ * @return true if the boot is slower than the baseline
+ */
+bool checkBootBaseline(const BootProfile& profile, const std::string& path,
+                       unsigned tolerance, bool update)
+{
+    auto baseline = BootProfile::loadBaseline(path);
+    bool regression =
+        !baseline.empty() && profile.compare(baseline, tolerance, stdout);
+
+    if ((update || baseline.empty()) && profile.saveBaseline(path))
+    {
+        printf("Boot phases baseline saved to %s\n", path.c_str());
+    }
+    if (regression)
+    {
+        printf("Boot performance regression detected.\n");
+    }
+
+    return regression;
+}
+
+/**
+ * @brief Show the audit log
+ *
+ * @param user   - user name or ID to show the records of, null for all
+ * @param failed - show the failed invocations only
+ * @param last   - number of the latest records to show, 0 for all
+ *
+ * @return exit code
+ */
+int showAuditLog(const char* user, bool failed, unsigned last)
+{
+    std::optional<uid_t> uid;
+    if (user)
+    {
+        unsigned id;
+        if (auto pw = getpwnam(user))
+        {
+            uid = pw->pw_uid;
+        }
+        else if (parseUnsigned(user, id))
+        {
+            uid = static_cast<uid_t>(id);
+        }
+        else
+        {
+            fprintf(stderr, "Unknown user: %s\n", user);
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<AuditEntry> entries;
+    if (!readAuditLog(auditFile, entries))
+    {
+        return EXIT_FAILURE;
+    }
+    std::erase_if(entries, [&](const AuditEntry& entry) {
+        return (uid && entry.uid != *uid) ||
+               (failed && entry.result == EXIT_SUCCESS);
+    });
+    if (last && entries.size() > last)
+    {
+        entries.erase(entries.begin(), entries.end() - last);
+    }
+
+    for (const auto& entry : entries)
+    {
+        std::string name = std::to_string(entry.uid);
+        if (auto pw = getpwuid(entry.uid))
+        {
+            name = pw->pw_name;
+        }
+        printf("%s %8s %6d %6u.%03u s rc %d: %s\n",
+               formatTime(entry.start).c_str(), name.c_str(), entry.pid,
+               entry.duration / 1000, entry.duration % 1000, entry.result,
+               entry.command.c_str());
+        if (!entry.states.empty())
+        {
+            printf("   ");
+            for (auto code : entry.states)
+            {
+                printf(" %s", decodeAuditState(code).c_str());
+            }
+            printf("\n");
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
 /**
  * @brief Show help message
  *
@@ -356,14 +988,86 @@ sdeventplus::source::EventBase::Callback getAction(const char* command)
  */
 void showUsage(const char* app)
 {
-    printf("Usage: %s <command>\n", app);
+    printf("Usage: %s [options] <command>\n", app);
     printf(R"(The commands:
-  on     - turn the host on
-  off    - turn the host off
-  soft   - gracefully turn the host off
-  reboot - cycle host power
-  status - show actual host power state
-)");
+  on                - turn the host on
+  off               - turn the host off
+  soft              - gracefully turn the host off
+  reboot            - cycle host power
+  warm-reboot       - gracefully restart the host keeping the chassis on
+  force-warm-reboot - restart the host immediately keeping the chassis on
+  cycle             - cycle the chassis power, with the power off and on
+                      if the PowerCycle transition is not supported
+  status            - show actual host power state
+  wait              - wait for the power state without changing it
+  publish           - keep the power state snapshot file up to date and
+                      report the host stuck in a transitional state longer
+                      than usual
+  log               - show the audit log of the power operations
+  rack-off          - gracefully turn all the hosts off within the
+                      timeout, force the power off of the hosts which are
+                      still on when the deadline minus margin arrives
+The options:
+  -c, --cached              read the power state from the snapshot file
+                            (status only)
+  -f, --file PATH           snapshot file path (default: %s)
+  -t, --timeout SEC         operation confirmation timeout, 0 to wait
+                            forever (default: %u)
+  -P, --stall SEC           fail the operation if none of the power
+                            states, the boot progress and the POST code
+                            changes for SEC seconds, the timer restarts
+                            on each change (default: disabled)
+  -H, --host-state STATE    host state to wait for (wait only)
+  -C, --chassis-state STATE chassis state to wait for (wait only)
+  -b, --baseline PATH       boot phases baseline file (on and reboots only,
+                            default: %s/host0-<command>.baseline)
+  -T, --tolerance PCT       allowed boot phase slowdown (default: %u%%)
+  -u, --update-baseline     replace the baseline with the measured durations
+  -o, --os-ready            wait for the operating system readiness
+                            (OperatingSystemState Standby or BootProgress
+                            OSRunning) after the host start, consider
+                            increasing the timeout (on and reboots only)
+  -S, --sequence PATH       power on or off the dependent hosts and chassis
+                            described in the file (on and off only), each
+                            line is: <name> <host|chassis> <path> [deps...]
+  -x, --trace PATH          write the operation timeline to the file in
+                            the Chrome trace format (Perfetto)
+  -e, --emergency[=SERVICE] send the forced power off request to the
+                            chassis manager right after the start, the
+                            object mapper is only asked on error
+                            (off only, default: %s)
+  -R, --realtime[=PRIO]     lock the memory and run with the SCHED_FIFO
+                            priority to bound the own latency on the
+                            overloaded system (default: %d)
+  -m, --margin SEC          time reserved for the forced power off
+                            (rack-off only, default: %u)
+  -O, --off-time SEC        minimal power off time of the cycle without
+                            the PowerCycle transition (cycle only,
+                            default: %u)
+  -B, --boot-source SRC     boot source set along with the host start:
+                            Disk, Network, ExternalMedia, RemovableMedia,
+                            HTTP or Default (on and reboots only)
+  -M, --boot-mode MODE      boot mode set along with the host start:
+                            Regular, Safe or Setup (on and reboots only)
+  -N, --boot-once           apply the boot source and mode to the next
+                            boot only
+  -K, --hang-hook CMD       shell command run when the host hang is
+                            detected, the HOST, HOST_STATE and DURATION_SEC
+                            variables describe the hang (publish only)
+  -A, --audit PATH          audit log path (default: %s)
+  -U, --user USER           show the records of the user (log only)
+  -F, --failed              show the failed invocations only (log only)
+  -L, --last N              show the latest N records only (log only)
+  -s, --stats               show the signal handling statistics on exit
+  -h, --help                show this help
+The exit code is %d if the boot is slower than the baseline.
+The recent bus events are dumped on failure or on SIGUSR1.
+The power operations are recorded to the audit log, the status, wait,
+publish and log commands are not recorded.
+)",
+           StateCache::defaultPath, confirmationTime, baselineDir,
+           defaultTolerance, chassisServicePrefix, defaultRealtimePriority,
+           defaultMargin, minOffTime, auditLogPath, exitRegression);
 }
 
 /**
@@ -371,45 +1075,411 @@ void showUsage(const char* app)
  */
 int main(int argc, char* argv[])
 {
-    if (argc != 2)
+    const struct option opts[] = {
+        {"cached", no_argument, nullptr, 'c'},
+        {"file", required_argument, nullptr, 'f'},
+        {"timeout", required_argument, nullptr, 't'},
+        {"stall", required_argument, nullptr, 'P'},
+        {"host-state", required_argument, nullptr, 'H'},
+        {"chassis-state", required_argument, nullptr, 'C'},
+        {"baseline", required_argument, nullptr, 'b'},
+        {"tolerance", required_argument, nullptr, 'T'},
+        {"update-baseline", no_argument, nullptr, 'u'},
+        {"os-ready", no_argument, nullptr, 'o'},
+        {"sequence", required_argument, nullptr, 'S'},
+        {"trace", required_argument, nullptr, 'x'},
+        {"emergency", optional_argument, nullptr, 'e'},
+        {"realtime", optional_argument, nullptr, 'R'},
+        {"margin", required_argument, nullptr, 'm'},
+        {"off-time", required_argument, nullptr, 'O'},
+        {"boot-source", required_argument, nullptr, 'B'},
+        {"boot-mode", required_argument, nullptr, 'M'},
+        {"boot-once", no_argument, nullptr, 'N'},
+        {"hang-hook", required_argument, nullptr, 'K'},
+        {"audit", required_argument, nullptr, 'A'},
+        {"user", required_argument, nullptr, 'U'},
+        {"failed", no_argument, nullptr, 'F'},
+        {"last", required_argument, nullptr, 'L'},
+        {"stats", no_argument, nullptr, 's'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    bool cached = false;
+    bool stats = false;
+    const char* snapshotFile = StateCache::defaultPath;
+    std::string baselineFile;
+    unsigned tolerance = defaultTolerance;
+    bool updateBaseline = false;
+    bool waitOsReady = false;
+    const char* sequenceFile = nullptr;
+    const char* traceFile = nullptr;
+    const char* emergencyService = nullptr;
+    bool realtime = false;
+    unsigned realtimePriority = defaultRealtimePriority;
+    unsigned margin = defaultMargin;
+    bool marginSet = false;
+    PowerControl::BootOverride boot{};
+    const char* auditUser = nullptr;
+    bool auditFailed = false;
+    unsigned auditLast = 0;
+
+    int opt;
+    const char* optstring = "cf:t:P:H:C:b:T:uoS:x:e::R::m:O:B:M:NK:A:U:FL:sh";
+    while ((opt = getopt_long(argc, argv, optstring, opts, nullptr)) != -1)
+    {
+        switch (opt)
+        {
+            case 'c':
+                cached = true;
+                break;
+            case 'f':
+                snapshotFile = optarg;
+                break;
+            case 't':
+                if (!parseUnsigned(optarg, confirmationTime))
+                {
+                    fprintf(stderr, "Invalid timeout: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'P':
+                if (!parseUnsigned(optarg, stallTime))
+                {
+                    fprintf(stderr, "Invalid stall timeout: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'b':
+                baselineFile = optarg;
+                break;
+            case 'T':
+                if (!parseUnsigned(optarg, tolerance))
+                {
+                    fprintf(stderr, "Invalid tolerance: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'u':
+                updateBaseline = true;
+                break;
+            case 'o':
+                waitOsReady = true;
+                break;
+            case 'S':
+                sequenceFile = optarg;
+                break;
+            case 'x':
+                traceFile = optarg;
+                break;
+            case 'H':
+                waitHostState = addClassName(hostStatePrefix, optarg);
+                break;
+            case 'C':
+                waitChassisState = addClassName(chassisStatePrefix, optarg);
+                break;
+            case 'e':
+                emergencyService = optarg ? optarg : "";
+                break;
+            case 'R':
+                realtime = true;
+                if (optarg && (!parseUnsigned(optarg, realtimePriority) ||
+                               !realtimePriority || realtimePriority > 99))
+                {
+                    fprintf(stderr, "Invalid priority: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'm':
+                if (!parseUnsigned(optarg, margin))
+                {
+                    fprintf(stderr, "Invalid margin: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                marginSet = true;
+                break;
+            case 'O':
+                if (!parseUnsigned(optarg, minOffTime))
+                {
+                    fprintf(stderr, "Invalid off time: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'B':
+                if (!parseEnumValue(optarg, bootSources, bootSourcePrefix,
+                                    boot.source))
+                {
+                    fprintf(stderr, "Invalid boot source: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'M':
+                if (!parseEnumValue(optarg, bootModes, bootModePrefix,
+                                    boot.mode))
+                {
+                    fprintf(stderr, "Invalid boot mode: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'N':
+                boot.once = true;
+                break;
+            case 'K':
+                hangHook = optarg;
+                break;
+            case 'A':
+                auditFile = optarg;
+                break;
+            case 'U':
+                auditUser = optarg;
+                break;
+            case 'F':
+                auditFailed = true;
+                break;
+            case 'L':
+                if (!parseUnsigned(optarg, auditLast))
+                {
+                    fprintf(stderr, "Invalid number of records: %s\n",
+                            optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 's':
+                stats = true;
+                break;
+            case 'h':
+                showUsage(argv[0]);
+                return EXIT_SUCCESS;
+            default:
+                showUsage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind + 1 != argc)
     {
         showUsage(argv[0]);
         return EXIT_FAILURE;
     }
 
-    auto action = getAction(argv[1]);
-    if (!action)
+    const char* command = argv[optind];
+    bool logCommand = 0 == strcmp(command, "log");
+    if ((auditUser || auditFailed || auditLast) && !logCommand)
+    {
+        fprintf(stderr, "Options --user, --failed and --last are supported "
+                        "by log only\n");
+        return EXIT_FAILURE;
+    }
+    if (logCommand)
+    {
+        return showAuditLog(auditUser, auditFailed, auditLast);
+    }
+
+    bool rackCommand = 0 == strcmp(command, "rack-off");
+    auto action = getAction(command);
+    if (!action && !rackCommand)
     {
         showUsage(argv[0]);
         return EXIT_FAILURE;
     }
 
-    systemBus.attach_event(systemEvent.get(), SD_EVENT_PRIORITY_NORMAL);
+    if (traceFile)
+    {
+        tracer().enable(std::string("hostpwrctl ") + command);
+    }
 
-    sdbusplus::bus::match::match hostStateMatch(
-        systemBus,
-        sdbusplus::bus::match::rules::propertiesChanged(hostPath, hostIface),
-        std::bind(onPropertiesChanged, std::placeholders::_1));
+    bool waitStateSet = !waitHostState.empty() || !waitChassisState.empty();
+    if (waitStateSet != (0 == strcmp(command, "wait")))
+    {
+        fprintf(stderr, "The state to wait for must be specified with "
+                        "the wait command only\n");
+        return EXIT_FAILURE;
+    }
 
-    sdbusplus::bus::match::match chassisStateMatch(
-        systemBus,
-        sdbusplus::bus::match::rules::propertiesChanged(chassisPath,
-                                                        chassisIface),
-        std::bind(onPropertiesChanged, std::placeholders::_1));
+    bool bootCommand = 0 == strcmp(command, "on") ||
+                       0 == strcmp(command, "reboot") ||
+                       0 == strcmp(command, "warm-reboot") ||
+                       0 == strcmp(command, "force-warm-reboot");
+    if (waitOsReady && !bootCommand)
+    {
+        fprintf(stderr, "Option --os-ready is supported by on and reboots "
+                        "only\n");
+        return EXIT_FAILURE;
+    }
 
-    sdeventplus::source::Defer defer(systemEvent, std::move(action));
+    if (!boot.source.empty() || !boot.mode.empty())
+    {
+        if (!bootCommand || sequenceFile)
+        {
+            fprintf(stderr, "Boot override is supported by on and reboots "
+                            "only\n");
+            return EXIT_FAILURE;
+        }
+        bootOverride = boot;
+    }
+    else if (boot.once)
+    {
+        fprintf(stderr, "Option --boot-once requires the boot source or "
+                        "mode\n");
+        return EXIT_FAILURE;
+    }
 
-    Timer timer{systemEvent,
-                [](Timer&) {
-                    printf("Unable to confirm operation success "
-                           "within timeout period (%d s).\n",
-                           confirmationTime);
-                    systemEvent.exit(EXIT_FAILURE);
-                },
-                std::chrono::seconds(confirmationTime)};
+    if (0 != strcmp(command, "status") && 0 != strcmp(command, "wait") &&
+        0 != strcmp(command, "publish"))
+    {
+        startAudit(argc, argv);
+    }
 
-    currentChassisState = getProperty(chassisPath, chassisIface, chassisState);
-    currentHostState = getProperty(hostPath, hostIface, hostState);
+    if (emergencyService)
+    {
+        if (0 != strcmp(command, "off") || sequenceFile || cached)
+        {
+            fprintf(stderr, "Option --emergency is supported by off only\n");
+            return EXIT_FAILURE;
+        }
+
+        // The request goes before any other bus traffic to cut the latency
+        systemBus.attach_event(systemEvent.get(), SD_EVENT_PRIORITY_NORMAL);
+        sendEmergencyOff(emergencyService);
+        action = followEmergencyOff;
+    }
+
+    if (realtime)
+    {
+        // Done before the regular requests but after the emergency one, the
+        // memory locking would add to its latency. The failure is not fatal.
+        enterRealtime(static_cast<int>(realtimePriority));
+    }
+
+    if (sequenceFile)
+    {
+        if (0 != strcmp(command, "on") && 0 != strcmp(command, "off"))
+        {
+            fprintf(stderr, "Option --sequence is supported by on and off "
+                            "only\n");
+            return EXIT_FAILURE;
+        }
+        return finishAudit(runSequence(
+            sequenceFile, 0 == strcmp(command, "on"), traceFile));
+    }
+
+    if (cached)
+    {
+        if (0 != strcmp(command, "status"))
+        {
+            fprintf(stderr, "Option --cached is supported by status only\n");
+            return EXIT_FAILURE;
+        }
+        return showCachedPowerStatus(snapshotFile);
+    }
+
+    if (rackCommand)
+    {
+        if (!confirmationTime || margin >= confirmationTime)
+        {
+            fprintf(stderr, "The margin must be less than the timeout\n");
+            return EXIT_FAILURE;
+        }
+        return finishAudit(runRackShutdown(margin, traceFile));
+    }
+    else if (marginSet)
+    {
+        fprintf(stderr, "Option --margin is supported by rack-off only\n");
+        return EXIT_FAILURE;
+    }
+
+    bool publishCommand = 0 == strcmp(command, "publish");
+    if (hangHook && !publishCommand)
+    {
+        fprintf(stderr, "Option --hang-hook is supported by publish only\n");
+        return EXIT_FAILURE;
+    }
+    if (publishCommand && !stateCache.publish(snapshotFile))
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (!emergencyService)
+    {
+        systemBus.attach_event(systemEvent.get(), SD_EVENT_PRIORITY_NORMAL);
+    }
+    auto dumpRequest = handleDumpRequest();
+    flightRecorder().record(FlightRecorder::Event::note, "command %s",
+                            command);
+
+    PowerControl power(systemBus, systemEvent);
+    power.setTimeout(std::chrono::seconds(confirmationTime));
+    power.setStallTimeout(std::chrono::seconds(stallTime));
+    power.setWaitOsReady(waitOsReady);
+    power.setBootOverride(bootOverride);
+    power.onStateChange(showStateChange);
+    if (publishCommand)
+    {
+        hangDetector.emplace(systemEvent,
+                             std::string(baselineDir) + "/" +
+                                 power.getName() + "-states.learned",
+                             onHostHang);
+        if (hangHook)
+        {
+            // The hook processes are reaped automatically
+            signal(SIGCHLD, SIG_IGN);
+        }
+    }
+    power.refresh([&power, action]() {
+        shownChassisState = power.getChassisState();
+        shownHostState = power.getHostState();
+        auditState(shownChassisState);
+        auditState(shownHostState);
+        action(power);
+    });
+
+    int rc = systemEvent.loop();
+    power.cancel();
+    hangDetector.reset();
+    const auto& profile = power.getProfile();
+    if (bootCommand && profile.isActive())
+    {
+        profile.report(stdout);
+
+        if (rc == EXIT_SUCCESS && requestJoined)
+        {
+            // The partial profile would make the baseline too short
+            printf("Boot phases of the joined request are not compared with "
+                   "the baseline.\n");
+        }
+        else if (rc == EXIT_SUCCESS)
+        {
+            if (baselineFile.empty())
+            {
+                baselineFile = std::string(baselineDir) + "/" +
+                               power.getName() + "-" + command + ".baseline";
+            }
+            if (checkBootBaseline(profile, baselineFile, tolerance,
+                                  updateBaseline))
+            {
+                logEvent({power.getName().c_str(), command, "Baseline",
+                          "regression", std::nullopt});
+                rc = exitRegression;
+            }
+        }
+    }
+    if (traceFile && !tracer().write(traceFile))
+    {
+        rc = EXIT_FAILURE;
+    }
+    if (rc != EXIT_SUCCESS && rc != exitRegression)
+    {
+        flightRecorder().dump(stderr);
+    }
+    if (stats)
+    {
+        const auto& signalStats = power.getStats();
+        fprintf(stderr,
+                "Signals received: %zu, state updates applied: %zu, "
+                "coalesced: %zu\n",
+                signalStats.received, signalStats.applied,
+                signalStats.coalesced);
+    }
 
-    return systemEvent.loop();
+    return finishAudit(rc);
 }
@@ -0,0 +1,57 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#include "journal.hpp"
+
+#include <sys/uio.h>
+#include <systemd/sd-journal.h>
+
+#include <string>
+#include <vector>
+
+namespace hostpwrctl
+{
+
+void logEvent(const OperationEvent& event)
+{
+    std::vector<std::string> fields;
+    fields.reserve(6);
+
+    std::string message = "MESSAGE=";
+    message += event.host;
+    message += ' ';
+    message += event.operation;
+    if (event.phase)
+    {
+        message += ' ';
+        message += event.phase;
+        fields.push_back(std::string("PHASE=") + event.phase);
+    }
+    if (event.result)
+    {
+        message += ": ";
+        message += event.result;
+        fields.push_back(std::string("RESULT=") + event.result);
+    }
+    if (event.duration)
+    {
+        fields.push_back("DURATION_USEC=" +
+                         std::to_string(event.duration->count()));
+    }
+    fields.push_back(std::string("HOST=") + event.host);
+    fields.push_back(std::string("OPERATION=") + event.operation);
+    fields.push_back(std::move(message));
+
+    std::vector<iovec> iov;
+    iov.reserve(fields.size());
+    for (auto& field : fields)
+    {
+        iov.push_back({field.data(), field.size()});
+    }
+
+    sd_journal_sendv(iov.data(), static_cast<int>(iov.size()));
+}
+
+} // namespace hostpwrctl
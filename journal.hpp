@@ -0,0 +1,36 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <optional>
+
+namespace hostpwrctl
+{
+
+/**
+ * @brief Power operation event.
+ *        The event is sent to the journal with the structured fields
+ *        HOST, OPERATION, PHASE, DURATION_USEC and RESULT, so it can be
+ *        selected by the field values (journalctl HOST=host0 -o json).
+ */
+struct OperationEvent
+{
+    const char* host;      // host or object name
+    const char* operation; // operation name
+    const char* phase;     // operation phase, may be null
+    const char* result;    // phase or operation result, may be null
+    std::optional<std::chrono::microseconds> duration;
+};
+
+/**
+ * @brief Send the operation event to the journal
+ *
+ * @param event - event to send
+ */
+void logEvent(const OperationEvent& event);
+
+} // namespace hostpwrctl
@@ -0,0 +1,891 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#include "powercontrol.hpp"
+
+#include "journal.hpp"
+#include "recorder.hpp"
+#include "state.hpp"
+#include "trace.hpp"
+
+#include <sys/epoll.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+namespace hostpwrctl
+{
+
+/**
+ * @brief Power operation details
+ */
+struct OperationInfo
+{
+    const char* name;         // operation name
+    bool chassis;             // transition of the chassis, host otherwise
+    const char* transition;   // requested transition
+    const char* hostState;    // expected host state
+    const char* chassisState; // expected chassis state
+    const char* skipState;    // chassis state making the request needless
+    bool restart;             // the host leaves the expected state first
+    bool warm;                // the chassis stays on
+};
+
+/** @brief Operation details indexed by PowerControl::Operation */
+static const OperationInfo operations[] = {
+    {"on", false, hostTransitionOn, hostStateOn, chassisStateOn,
+     chassisStateOn, false, false},
+    {"off", true, chassisTransitionOff, hostStateOff, chassisStateOff,
+     chassisStateOff, false, false},
+    {"soft", false, hostTransitionOff, hostStateOff, chassisStateOff,
+     chassisStateOff, false, false},
+    {"reboot", false, hostTransitionReboot, hostStateOn, chassisStateOn,
+     chassisStateOff, true, false},
+    {"warm-reboot", false, hostTransitionWarmReboot, hostStateOn,
+     chassisStateOn, chassisStateOff, true, true},
+    {"force-warm-reboot", false, hostTransitionForceWarmReboot, hostStateOn,
+     chassisStateOn, chassisStateOff, true, true},
+    {"power-cycle", true, chassisTransitionPowerCycle, "", chassisStateOn,
+     chassisStateOff, true, false},
+};
+
+/**
+ * @brief Property Sets sent at once and confirmed together
+ */
+struct SetBatch
+{
+    struct Set
+    {
+        std::string path;                      // object path
+        const char* iface;                     // D-Bus interface
+        const char* name;                      // property name
+        std::variant<std::string, bool> value; // new value
+    };
+
+    std::vector<Set> sets;             // Sets in the order of sending
+    std::vector<std::string> services; // resolved services of the Sets
+    size_t unresolved = 0;             // services not resolved yet
+    size_t pending = 0;                // Sets not confirmed yet
+    bool failed = false; // any of the Sets or the lookups is failed
+    std::function<void(bool)> done;
+};
+
+/**
+ * @brief Send the Sets of the batch back to back, without waiting for
+ *        the replies in between
+ *
+ * @param bus   - D-Bus connection
+ * @param batch - batch with the resolved services
+ */
+static void sendSets(sdbusplus::bus::bus& bus, std::shared_ptr<SetBatch> batch)
+{
+    if (batch->failed)
+    {
+        batch->done(false);
+        return;
+    }
+
+    batch->pending = batch->sets.size();
+    for (size_t i = 0; i < batch->sets.size(); ++i)
+    {
+        const auto& set = batch->sets[i];
+        auto onSet = [batch](bool success) {
+            batch->failed |= !success;
+            if (--batch->pending == 0)
+            {
+                batch->done(!batch->failed);
+            }
+        };
+        std::visit(
+            [&](const auto& value) {
+                using T = std::decay_t<decltype(value)>;
+                Property<T> prop{set.path.c_str(), set.iface, set.name};
+                setPropertyAt(bus, batch->services[i], prop, value, onSet);
+            },
+            set.value);
+    }
+}
+
+/**
+ * @brief Resolve the services of the batch and send all the Sets at once.
+ *        Nothing is sent if any of the services is not resolved.
+ *
+ * @param bus   - D-Bus connection
+ * @param batch - batch to send
+ */
+static void sendBatch(sdbusplus::bus::bus& bus, std::shared_ptr<SetBatch> batch)
+{
+    batch->services.resize(batch->sets.size());
+    batch->unresolved = batch->sets.size();
+    for (size_t i = 0; i < batch->sets.size(); ++i)
+    {
+        const auto& set = batch->sets[i];
+        resolveService(bus, set.path, set.iface,
+                       [&bus, batch, i](const std::string& service) {
+                           batch->services[i] = service;
+                           batch->failed |= service.empty();
+                           if (--batch->unresolved == 0)
+                           {
+                               sendSets(bus, batch);
+                           }
+                       });
+    }
+}
+
+PowerControl::PowerControl(sdbusplus::bus::bus& bus,
+                           const sdeventplus::Event& event, unsigned index) :
+    bus(bus),
+    event(event), name("host" + std::to_string(index)),
+    chassisPath(chassisPathPrefix + std::to_string(index)),
+    hostPath(hostPathPrefix + std::to_string(index)),
+    postCodePath(postCodePathPrefix + std::to_string(index)),
+    bootPath(bootSettingsPathPrefix + std::to_string(index) +
+             bootSettingsPathSuffix),
+    bootOncePath(bootSettingsPathPrefix + std::to_string(index) +
+                 bootOncePathSuffix),
+    chassisService(chassisServicePrefix +
+                   (index ? std::to_string(index) : std::string())),
+    hostService(hostServicePrefix +
+                (index ? std::to_string(index) : std::string())),
+    chassisStateProperty{chassisPath.c_str(), chassisIface, chassisState},
+    chassisTransitionProperty{chassisPath.c_str(), chassisIface,
+                              chassisTransition},
+    hostStateProperty{hostPath.c_str(), hostIface, hostState},
+    hostTransitionProperty{hostPath.c_str(), hostIface, hostTransition},
+    readiness(bus, event),
+    refreshDone(event,
+                [this](sdeventplus::source::EventBase&) {
+                    auto done = std::move(refreshCompletion);
+                    refreshCompletion = nullptr;
+                    if (done)
+                    {
+                        done();
+                    }
+                }),
+    stateUpdate(event,
+                [this](sdeventplus::source::EventBase&) {
+                    applyStateUpdates();
+                }),
+    confirmationTimer(event, [this](Timer&) {
+        flightRecorder().record(FlightRecorder::Event::timer, "expired");
+        complete(Result::timeout);
+    }),
+    stallTimer(event, [this](Timer&) {
+        flightRecorder().record(FlightRecorder::Event::timer, "stalled");
+        logOperation("Progress", "stalled");
+        complete(Result::timeout);
+    }),
+    sharedRequestCheck(event, [this](sdeventplus::source::EventBase&) {
+        checkSharedRequest();
+    })
+{
+    refreshDone.set_enabled(sdeventplus::source::Enabled::Off);
+    sharedRequestCheck.set_enabled(sdeventplus::source::Enabled::Off);
+
+    // Lower priority than the bus to let the queued signals be coalesced
+    stateUpdate.set_priority(SD_EVENT_PRIORITY_IDLE);
+    stateUpdate.set_enabled(sdeventplus::source::Enabled::Off);
+
+    namespace rules = sdbusplus::bus::match::rules;
+    auto onState = [this](sdbusplus::message::message& m) {
+        onPropertiesChanged(m);
+    };
+    auto onBoot = [this](sdbusplus::message::message& m) {
+        onBootProgress(m);
+    };
+    matches.reserve(5);
+    matches.emplace_back(bus, rules::propertiesChanged(hostPath, hostIface),
+                         onState);
+    matches.emplace_back(
+        bus, rules::propertiesChanged(chassisPath, chassisIface), onState);
+    matches.emplace_back(
+        bus, rules::propertiesChanged(hostPath, bootProgressIface), onBoot);
+    matches.emplace_back(bus, rules::propertiesChanged(hostPath, osStatusIface),
+                         onBoot);
+    matches.emplace_back(
+        bus, rules::propertiesChanged(postCodePath, postCodeIface), onBoot);
+}
+
+void PowerControl::refresh(std::function<void()>&& done)
+{
+    readStates(std::move(done), true);
+}
+
+void PowerControl::readStates(std::function<void()>&& done, bool retry)
+{
+    std::weak_ptr<bool> alive = lifetime;
+    auto pending = std::make_shared<size_t>(2);
+    auto failed = std::make_shared<bool>(false);
+    auto finish = [this, alive, pending, failed, retry,
+                   done = std::move(done)]() mutable {
+        if (--*pending || alive.expired())
+        {
+            return;
+        }
+        if (*failed && retry)
+        {
+            waitServices(std::move(done));
+            return;
+        }
+        tracer().state(track("Chassis state"),
+                       trimClassName(currentChassisState));
+        tracer().state(track("Host state"), trimClassName(currentHostState));
+        finishRefresh(std::move(done));
+    };
+    auto shared = std::make_shared<decltype(finish)>(std::move(finish));
+
+    // Both requests are sent at once, so the refresh costs two round trips
+    readProperty(
+        bus, chassisStateProperty,
+        [this, alive, failed, shared](std::optional<std::string> value) {
+            if (!alive.expired())
+            {
+                *failed |= !value;
+                currentChassisState = value.value_or(std::string());
+            }
+            (*shared)();
+        });
+    readProperty(
+        bus, hostStateProperty,
+        [this, alive, failed, shared](std::optional<std::string> value) {
+            if (!alive.expired())
+            {
+                *failed |= !value;
+                currentHostState = value.value_or(std::string());
+            }
+            (*shared)();
+        });
+}
+
+void PowerControl::waitServices(std::function<void()>&& done)
+{
+    flightRecorder().record(FlightRecorder::Event::note,
+                            "waiting for the services");
+    auto started = std::chrono::steady_clock::now();
+    std::chrono::microseconds timeout = confirmationTime;
+    readiness.wait(
+        {mapperService, chassisService, hostService}, timeout,
+        [this, started, done = std::move(done)](bool ready) mutable {
+            readinessDelay = std::chrono::steady_clock::now() - started;
+            if (!ready)
+            {
+                for (const auto& service : readiness.getMissing())
+                {
+                    fprintf(stderr, "Service %s is not available\n",
+                            service.c_str());
+                }
+                finishRefresh(std::move(done));
+                return;
+            }
+
+            // The mapper may not know the just started services yet
+            addService(chassisPath, chassisIface, chassisService);
+            addService(hostPath, hostIface, hostService);
+            readStates(std::move(done), false);
+        });
+}
+
+void PowerControl::finishRefresh(std::function<void()>&& done)
+{
+    // The handler may call sd_bus_process(), which fails with EBUSY inside
+    // the reply handler
+    refreshCompletion = std::move(done);
+    refreshDone.set_enabled(sdeventplus::source::Enabled::OneShot);
+}
+
+PowerControl::Status PowerControl::request(Operation operation,
+                                           Callback&& done)
+{
+    if (isBusy())
+    {
+        return Status::busy;
+    }
+
+    const auto& info = operations[static_cast<size_t>(operation)];
+    if (currentChassisState == info.skipState)
+    {
+        return Status::skipped;
+    }
+
+    begin(info.name, std::move(done));
+    profile.start();
+    // Only the expected state reached already has to be left first, e.g.
+    // the reboot from Quiesced completes on the first Running
+    bool reached = (!*info.hostState || currentHostState == info.hostState) &&
+                   currentChassisState == info.chassisState;
+    restarting = info.restart && reached;
+    warmRestart = info.warm;
+
+    // The forced power off is the way to escalate any stuck request
+    bool preempt = operation == Operation::off;
+    switch (sharedRequest.claim(sharedRequestPath().c_str(), info.name,
+                                preempt))
+    {
+        case SharedRequest::Status::joined:
+        {
+            logOperation("Request", "joined");
+            watchSharedRequest();
+            // The owner killed does not store the result
+            int fd = sharedRequest.watchOwner();
+            if (fd != -1)
+            {
+                ownerWatch.emplace(
+                    event, fd, EPOLLIN,
+                    [this](sdeventplus::source::IO&, int, uint32_t) {
+                        checkSharedRequest();
+                    });
+            }
+            expect(info.hostState, info.chassisState);
+            // The record may be finished before the watch is armed
+            sharedRequestCheck.set_enabled(
+                sdeventplus::source::Enabled::OneShot);
+            return Status::joined;
+        }
+        case SharedRequest::Status::conflict:
+            logOperation("Request", "rejected");
+            logOperation(nullptr, "failure");
+            operationName = nullptr;
+            completion = nullptr;
+            return Status::conflict;
+        case SharedRequest::Status::takenOver:
+            logOperation("Request", "took over");
+            watchSharedRequest();
+            break;
+        case SharedRequest::Status::owner:
+            watchSharedRequest();
+            break;
+        case SharedRequest::Status::error:
+            break;
+    }
+
+    // The states are expected before sending, the request may fail at once
+    expect(info.hostState, info.chassisState);
+    sending = true;
+
+    const auto& property =
+        info.chassis ? chassisTransitionProperty : hostTransitionProperty;
+    // The late reply of the timed out operation must not complete the next one
+    std::weak_ptr<bool> alive = lifetime;
+    auto sender = generation;
+    auto onSent = [this, alive, sender](bool success) {
+        if (alive.expired() || sender != generation)
+        {
+            return;
+        }
+        logOperation("Request", success ? "accepted" : "failed");
+        if (!success)
+        {
+            complete(Result::failure);
+        }
+    };
+    // Only the host start uses the boot settings, not the graceful power off
+    if (bootOverride && std::string_view(info.hostState) == hostStateOn)
+    {
+        // The settings are sent at once, the transition only after all of
+        // them are accepted, so the host never boots with the old settings
+        auto batch = std::make_shared<SetBatch>();
+        if (!bootOverride->source.empty())
+        {
+            batch->sets.push_back({bootPath, bootSourceIface,
+                                   bootSourceProperty, bootOverride->source});
+        }
+        if (!bootOverride->mode.empty())
+        {
+            batch->sets.push_back({bootPath, bootModeIface, bootModeProperty,
+                                   bootOverride->mode});
+        }
+        batch->sets.push_back(
+            {bootPath, objectEnableIface, objectEnableProperty, true});
+        batch->sets.push_back({bootOncePath, objectEnableIface,
+                               objectEnableProperty, bootOverride->once});
+        batch->done = [this, alive, sender, property,
+                       transition = std::string(info.transition),
+                       onSent = std::move(onSent)](bool success) mutable {
+            if (alive.expired() || sender != generation)
+            {
+                return;
+            }
+            logOperation("Boot override", success ? "accepted" : "failed");
+            if (!success)
+            {
+                fprintf(stderr, "Boot override is not accepted, the host "
+                                "transition is not requested\n");
+                complete(Result::failure);
+                return;
+            }
+            setProperty(bus, property, std::move(transition),
+                        std::move(onSent));
+        };
+        sendBatch(bus, batch);
+    }
+    else
+    {
+        setProperty(bus, property, std::string(info.transition),
+                    std::move(onSent));
+    }
+    sending = false;
+
+    return isBusy() ? Status::sent : Status::failed;
+}
+
+bool PowerControl::follow(Operation operation, Callback&& done)
+{
+    if (isBusy())
+    {
+        return false;
+    }
+
+    const auto& info = operations[static_cast<size_t>(operation)];
+    begin(info.name, std::move(done));
+    profile.start();
+    // The forced power off sent elsewhere replaces the other requests too,
+    // so their owners and joiners do not wait for the overridden states
+    if (sharedRequest.claim(sharedRequestPath().c_str(), info.name,
+                            operation == Operation::off) ==
+        SharedRequest::Status::takenOver)
+    {
+        logOperation("Request", "took over");
+    }
+    expect(info.hostState, info.chassisState);
+    checkExpectedState();
+
+    return true;
+}
+
+bool PowerControl::Awaiter::await_suspend(std::coroutine_handle<> handle)
+{
+    status = power.request(operation, [this, handle](Result done) {
+        result = done;
+        resumeLater(power.event.get(), handle);
+    });
+    switch (status)
+    {
+        case Status::sent:
+        case Status::joined:
+            return true;
+        case Status::skipped:
+            result = Result::success;
+            break;
+        case Status::failed:
+        case Status::conflict:
+        case Status::busy:
+            result = Result::failure;
+            break;
+    }
+    return false;
+}
+
+bool PowerControl::wait(const std::string& host, const std::string& chassis,
+                        Callback&& done)
+{
+    if (isBusy())
+    {
+        return false;
+    }
+
+    begin("wait", std::move(done));
+    expect(host, chassis);
+    checkExpectedState();
+
+    return true;
+}
+
+void PowerControl::cancel()
+{
+    confirmationTimer.setEnabled(false);
+    stallTimer.setEnabled(false);
+    sharedRequestWatch.reset();
+    ownerWatch.reset();
+    sharedRequestCheck.set_enabled(sdeventplus::source::Enabled::Off);
+    expectedHostState.clear();
+    expectedChassisState.clear();
+    completion = nullptr;
+    operationName = nullptr;
+    restarting = false;
+    warmRestart = false;
+}
+
+std::string PowerControl::track(const std::string& what) const
+{
+    return name == hostName ? what : name + ": " + what;
+}
+
+std::string PowerControl::sharedRequestPath() const
+{
+    std::string path = SharedRequest::defaultPath;
+    if (name != hostName)
+    {
+        path += '-' + name;
+    }
+    return path;
+}
+
+void PowerControl::begin(const char* operation, Callback&& done)
+{
+    ++generation;
+    operationName = operation;
+    operationStart = std::chrono::steady_clock::now();
+    completion = std::move(done);
+    osReady = false;
+    tracer().state(track("Operation"), operation);
+}
+
+void PowerControl::expect(const std::string& host, const std::string& chassis)
+{
+    expectedHostState = host;
+    expectedChassisState = chassis;
+    if (confirmationTime.count())
+    {
+        // The time spent waiting for the services counts too
+        auto timeout = std::max(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                confirmationTime - readinessDelay),
+            std::chrono::microseconds(1));
+        readinessDelay = {};
+        confirmationTimer.restartOnce(timeout);
+        flightRecorder().record(
+            FlightRecorder::Event::timer, "armed for %llu ms",
+            static_cast<unsigned long long>(timeout.count() / 1000));
+    }
+    progress("operation start");
+}
+
+void PowerControl::progress(const std::string& what)
+{
+    if (!completion || !stallTime.count())
+    {
+        return;
+    }
+    stallTimer.restartOnce(stallTime);
+    flightRecorder().record(FlightRecorder::Event::timer,
+                            "stall timer restarted by %s", what.c_str());
+}
+
+void PowerControl::checkExpectedState()
+{
+    if (expectedHostState.empty() && expectedChassisState.empty())
+    {
+        // Nothing is expected yet
+        return;
+    }
+    bool reached =
+        (expectedHostState.empty() || expectedHostState == currentHostState) &&
+        (expectedChassisState.empty() ||
+         expectedChassisState == currentChassisState);
+    if (restarting)
+    {
+        // The initial state is the expected one, wait for it to be left
+        restarting = reached;
+        return;
+    }
+    // The OS readiness only makes sense when the host is started
+    bool osExpected = waitOsReady && expectedHostState == hostStateOn;
+    if (reached && (!osExpected || osReady))
+    {
+        complete(Result::success);
+    }
+}
+
+void PowerControl::watchSharedRequest()
+{
+    int fd = sharedRequest.watch();
+    if (fd != -1)
+    {
+        sharedRequestWatch.emplace(
+            event, fd, EPOLLIN,
+            [this](sdeventplus::source::IO&, int, uint32_t) {
+                checkSharedRequest();
+            });
+    }
+}
+
+void PowerControl::checkSharedRequest()
+{
+    if (sharedRequest.isReplaced())
+    {
+        // The forced power off of another process overrides ours
+        logOperation("Request", "replaced");
+        complete(Result::failure);
+        return;
+    }
+
+    auto result = sharedRequest.getResult();
+    if (result)
+    {
+        complete(*result == EXIT_SUCCESS ? Result::success : Result::failure);
+    }
+}
+
+void PowerControl::complete(Result result)
+{
+    if (!completion)
+    {
+        return;
+    }
+
+    profile.finish();
+    sharedRequest.finish(result == Result::success ? EXIT_SUCCESS
+                                                   : EXIT_FAILURE);
+
+    for (const auto& phase : profile.getPhases())
+    {
+        logOperation(
+            phase.name.c_str(), "completed",
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                phase.duration));
+    }
+    const char* results[] = {"success", "failure", "timeout"};
+    logOperation(nullptr, results[static_cast<size_t>(result)]);
+
+    // The handler may start the next operation
+    auto done = std::move(completion);
+    cancel();
+    if (!sending)
+    {
+        // The failure to send is returned as the start status instead
+        done(result);
+    }
+}
+
+void PowerControl::logOperation(
+    const char* phase, const char* result,
+    std::optional<std::chrono::microseconds> duration)
+{
+    if (!operationName)
+    {
+        return;
+    }
+    if (!duration)
+    {
+        duration = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - operationStart);
+    }
+    logEvent({name.c_str(), operationName, phase, result, duration});
+}
+
+void PowerControl::applyStateUpdates()
+{
+    if (!pendingChassisState && !pendingHostState)
+    {
+        return;
+    }
+
+    ++signalStats.applied;
+    if (pendingChassisState)
+    {
+        currentChassisState = std::move(*pendingChassisState);
+        pendingChassisState.reset();
+    }
+    if (pendingHostState)
+    {
+        currentHostState = std::move(*pendingHostState);
+        pendingHostState.reset();
+    }
+
+    if (stateHandler)
+    {
+        stateHandler(currentChassisState, currentHostState);
+    }
+    checkExpectedState();
+}
+
+void PowerControl::onPropertiesChanged(sdbusplus::message::message& m)
+{
+    std::string iface;
+    std::map<std::string, std::variant<std::string, uint64_t>> data;
+    std::vector<std::string> v;
+
+    m.read(iface, data, v);
+    ++signalStats.received;
+
+    std::optional<std::string>* pending = nullptr;
+    const std::string* current = nullptr;
+    const std::string* expected = nullptr;
+    const char* property = nullptr;
+    const char* phasePrefix = nullptr;
+    if (iface == chassisIface)
+    {
+        pending = &pendingChassisState;
+        current = &currentChassisState;
+        expected = &expectedChassisState;
+        property = chassisState;
+        phasePrefix = "Chassis";
+    }
+    else if (iface == hostIface)
+    {
+        pending = &pendingHostState;
+        current = &currentHostState;
+        expected = &expectedHostState;
+        property = hostState;
+        phasePrefix = "Host";
+    }
+    else
+    {
+        return;
+    }
+
+    auto it = data.find(property);
+    if (it == data.end())
+    {
+        return;
+    }
+    auto value = std::get_if<std::string>(&it->second);
+    if (value)
+    {
+        flightRecorder().record(FlightRecorder::Event::signal, "%s=%s",
+                                property, value->c_str());
+        tracer().state(track(std::string(phasePrefix) + " state"),
+                       trimClassName(*value));
+
+        // The phase is marked here to get the exact time of the change
+        profile.mark(phasePrefix + trimClassName(*value));
+
+        if (*value != (*pending ? **pending : *current))
+        {
+            progress(property);
+        }
+
+        // The states left within the coalesced burst are not seen later
+        if (restarting && !expected->empty() && *value != *expected)
+        {
+            restarting = false;
+        }
+        if (warmRestart && completion && *value == chassisStateOff)
+        {
+            // The warm reboot is expected to keep the chassis on
+            logOperation("Chassis", "powered off");
+            warmRestart = false;
+        }
+
+        if (*pending)
+        {
+            ++signalStats.coalesced;
+        }
+        *pending = std::move(*value);
+        stateUpdate.set_enabled(sdeventplus::source::Enabled::OneShot);
+    }
+}
+
+void PowerControl::onBootProgress(sdbusplus::message::message& m)
+{
+    using PostCode = std::tuple<uint64_t, std::vector<uint8_t>>;
+
+    std::string iface;
+    std::map<std::string, std::variant<std::string, uint64_t, PostCode>> data;
+    std::vector<std::string> v;
+
+    m.read(iface, data, v);
+
+    if (iface == bootProgressIface)
+    {
+        auto it = data.find(bootProgressProperty.name);
+        if (it != data.end())
+        {
+            auto value = std::get_if<std::string>(&it->second);
+            if (value)
+            {
+                flightRecorder().record(FlightRecorder::Event::signal,
+                                        "%s=%s", bootProgressProperty.name,
+                                        value->c_str());
+                tracer().state(track("Boot progress"),
+                               trimClassName(*value));
+                profile.mark(trimClassName(*value));
+                progress(bootProgressProperty.name);
+                if (*value == bootProgressOsRunning)
+                {
+                    osReady = true;
+                    checkExpectedState();
+                }
+            }
+        }
+    }
+    else if (iface == osStatusIface)
+    {
+        auto it = data.find(osStatusProperty.name);
+        if (it != data.end())
+        {
+            auto value = std::get_if<std::string>(&it->second);
+            if (value)
+            {
+                flightRecorder().record(FlightRecorder::Event::signal,
+                                        "%s=%s", osStatusProperty.name,
+                                        value->c_str());
+                tracer().state(track("OS state"), trimClassName(*value));
+                profile.mark("OS" + trimClassName(*value));
+                progress(osStatusProperty.name);
+                if (*value == osStatusStandby)
+                {
+                    osReady = true;
+                    checkExpectedState();
+                }
+            }
+        }
+    }
+    else if (iface == postCodeIface)
+    {
+        auto it = data.find(postCodeProperty);
+        if (it != data.end())
+        {
+            // Older implementations report the bare code
+            uint64_t code = 0;
+            if (auto raw = std::get_if<uint64_t>(&it->second))
+            {
+                code = *raw;
+            }
+            else if (auto raw = std::get_if<PostCode>(&it->second))
+            {
+                code = std::get<0>(*raw);
+            }
+            flightRecorder().record(FlightRecorder::Event::signal,
+                                    "POST code 0x%llx",
+                                    static_cast<unsigned long long>(code));
+            profile.postCode(code);
+            progress("POST code");
+        }
+    }
+}
+
+void requestEmergencyOff(sdbusplus::bus::bus& bus, unsigned index,
+                         const std::string& service,
+                         std::function<void(bool)>&& done)
+{
+    // The descriptor refers to the path until the fallback is finished
+    auto path = std::make_shared<std::string>(chassisPathPrefix +
+                                              std::to_string(index));
+    Property<std::string> property{path->c_str(), chassisIface,
+                                   chassisTransition};
+    std::string destination = service;
+    if (destination.empty())
+    {
+        destination = chassisServicePrefix;
+        if (index)
+        {
+            destination += std::to_string(index);
+        }
+    }
+
+    setPropertyAt(
+        bus, destination, property, std::string(chassisTransitionOff),
+        [&bus, path, property, done = std::move(done)](bool success) {
+            if (success)
+            {
+                done(true);
+                return;
+            }
+            fprintf(stderr, "Retrying with the object mapper\n");
+            setProperty(bus, property, std::string(chassisTransitionOff),
+                        [path, done](bool success) { done(success); });
+        });
+}
+
+} // namespace hostpwrctl
@@ -0,0 +1,551 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#pragma once
+
+#include "bootprofile.hpp"
+#include "coroutine.hpp"
+#include "dbus.hpp"
+#include "readiness.hpp"
+#include "request.hpp"
+
+#include <sdbusplus/bus.hpp>
+#include <sdbusplus/bus/match.hpp>
+#include <sdeventplus/clock.hpp>
+#include <sdeventplus/event.hpp>
+#include <sdeventplus/source/event.hpp>
+#include <sdeventplus/source/io.hpp>
+#include <sdeventplus/utility/timer.hpp>
+
+#include <chrono>
+#include <coroutine>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace hostpwrctl
+{
+
+/**
+ * @brief Asynchronous power control of the host.
+ *
+ *        The object works on the D-Bus connection and the event loop of
+ *        the application, so it can be embedded into the BMC daemons
+ *        without an extra process or connection. The bus must be attached
+ *        to the event loop. The current states are tracked with the
+ *        PropertiesChanged signals, the operation is completed when the
+ *        expected states are reached or the confirmation timeout expires.
+ *        Only one operation is handled at a time.
+ */
+class PowerControl
+{
+  public:
+    /** @brief Power operation */
+    enum class Operation
+    {
+        on,     // turn the host on
+        off,    // turn the chassis off
+        soft,   // gracefully turn the host off
+        reboot, // cycle the host power
+
+        // Restart the host keeping the chassis power on, gracefully or not
+        warmReboot,
+        forceWarmReboot,
+
+        // Cycle the chassis power, the host state is not tracked
+        powerCycle,
+    };
+
+    /** @brief Start status of the operation */
+    enum class Status
+    {
+        sent,     // the transition request is sent
+        joined,   // the same request of another process is in progress
+        skipped,  // the host is already in the requested state
+        failed,   // the request is failed to be sent
+        conflict, // other request of another process is in progress
+        busy,     // other operation of this object is in progress
+    };
+
+    /** @brief Operation result */
+    enum class Result
+    {
+        success, // the expected state is reached
+        failure, // the request is failed
+        timeout, // the expected state is not reached in time
+    };
+
+    /** @brief Operation completion handler */
+    using Callback = std::function<void(Result)>;
+
+    /**
+     * @brief State change handler, the arguments are the current
+     *        chassis and host states
+     */
+    using StateHandler =
+        std::function<void(const std::string&, const std::string&)>;
+
+    /** @brief Signal handling statistics */
+    struct SignalStats
+    {
+        size_t received;  // PropertiesChanged signals received
+        size_t applied;   // state updates applied
+        size_t coalesced; // state updates replaced by the newer ones
+    };
+
+    /** @brief Boot override sent along with the host start */
+    struct BootOverride
+    {
+        std::string source; // BootSource value, empty to keep the current
+        std::string mode;   // BootMode value, empty to keep the current
+        bool once;          // apply to the next boot only
+    };
+
+    /**
+     * @brief Constructor, subscribes to the state signals
+     *
+     * @param bus   - D-Bus connection attached to the event loop
+     * @param event - event loop
+     * @param index - host and chassis index, 0 for the single host systems
+     */
+    PowerControl(sdbusplus::bus::bus& bus, const sdeventplus::Event& event,
+                 unsigned index = 0);
+
+    PowerControl(const PowerControl&) = delete;
+    PowerControl& operator=(const PowerControl&) = delete;
+
+    /**
+     * @brief Set the operation confirmation timeout
+     *
+     * @param timeout - timeout, 0 to wait forever
+     */
+    void setTimeout(std::chrono::milliseconds timeout)
+    {
+        confirmationTime = timeout;
+    }
+
+    /**
+     * @brief Do not take the time spent waiting for the services from the
+     *        next operation timeout, e.g. if the caller has done it already
+     */
+    void clearReadinessDelay()
+    {
+        readinessDelay = {};
+    }
+
+    /**
+     * @brief Set the stall timeout, the operation fails if none of the host
+     *        and chassis states, the boot progress, the OS status and the
+     *        POST code changes within it. Unlike the confirmation timeout,
+     *        it is restarted on each change.
+     *
+     * @param timeout - timeout, 0 to disable the stall detection
+     */
+    void setStallTimeout(std::chrono::milliseconds timeout)
+    {
+        stallTime = timeout;
+    }
+
+    /**
+     * @brief Wait for the operating system readiness (OperatingSystemState
+     *        Standby or BootProgress OSRunning) in addition to the host state
+     *        when the host is started
+     *
+     * @param wait - true to wait
+     */
+    void setWaitOsReady(bool wait)
+    {
+        waitOsReady = wait;
+    }
+
+    /**
+     * @brief Set the boot override for the operations starting the host
+     *        (on and reboots), the other operations ignore it.
+     *        The boot settings are sent at once after their services are
+     *        resolved, the host transition is sent after all of them are
+     *        accepted. If any of them fails, the transition is not sent and
+     *        the operation fails.
+     *
+     * @param boot - boot override, empty to send the transition only
+     */
+    void setBootOverride(std::optional<BootOverride> boot)
+    {
+        bootOverride = std::move(boot);
+    }
+
+    /**
+     * @brief Set the handler called after the state changes are applied
+     *
+     * @param handler - state change handler
+     */
+    void onStateChange(StateHandler&& handler)
+    {
+        stateHandler = std::move(handler);
+    }
+
+    /**
+     * @brief Read the current states, the signals keep them up to date
+     *        after that.
+     *        If the states are not available, it waits for the object mapper
+     *        and the state managers to appear on the bus (e.g. during the BMC
+     *        boot) and reads the states again. The time spent waiting is
+     *        taken from the confirmation timeout of the next operation.
+     *
+     * @param done - completion handler, it is called from the event loop
+     *               rather than from the bus processing, so it may use
+     *               the blocking D-Bus calls
+     */
+    void refresh(std::function<void()>&& done);
+
+    /**
+     * @brief Start the power operation.
+     *        The completion handler is not called unless the request is
+     *        sent or joined, the request failed at once is reported with
+     *        the start status.
+     *
+     * @param operation - power operation
+     * @param done      - completion handler
+     *
+     * @return start status
+     */
+    Status request(Operation operation, Callback&& done);
+
+    /**
+     * @brief Wait for the completion of the operation requested elsewhere,
+     *        e.g. with requestEmergencyOff().
+     *        The forced power off takes the shared request record over like
+     *        request() does.
+     *
+     * @param operation - power operation
+     * @param done      - completion handler, it is called immediately if
+     *                    the expected states are already reached
+     *
+     * @return false if other operation is in progress
+     */
+    bool follow(Operation operation, Callback&& done);
+
+    /**
+     * @brief Awaitable power operation, see run()
+     */
+    class Awaiter
+    {
+      public:
+        Awaiter(PowerControl& power, Operation operation) :
+            power(power), operation(operation)
+        {}
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle);
+
+        Result await_resume() const noexcept
+        {
+            return result;
+        }
+
+        /**
+         * @brief Get the start status, e.g. to tell the request rejected by
+         *        the state manager from the conflicting one
+         */
+        Status getStatus() const
+        {
+            return status;
+        }
+
+      private:
+        PowerControl& power;
+        Operation operation;
+        Status status = Status::busy;
+        Result result = Result::failure;
+    };
+
+    /**
+     * @brief Run the power operation in the coroutine.
+     *        The operation succeeds at once if the host is already in the
+     *        requested state and fails at once if it can not be started.
+     *
+     * @param operation - power operation
+     *
+     * @return awaitable operation result
+     */
+    Awaiter run(Operation operation)
+    {
+        return Awaiter(*this, operation);
+    }
+
+    /**
+     * @brief Wait for the states without changing them
+     *
+     * @param host    - expected host state, empty to ignore the host state
+     * @param chassis - expected chassis state, empty to ignore the chassis
+     *                  state
+     * @param done    - completion handler, it is called immediately if the
+     *                  states are already reached
+     *
+     * @return false if other operation is in progress
+     */
+    bool wait(const std::string& host, const std::string& chassis,
+              Callback&& done);
+
+    /**
+     * @brief Stop waiting for the operation completion,
+     *        the completion handler is not called
+     */
+    void cancel();
+
+    /**
+     * @brief Check if the operation is in progress
+     */
+    bool isBusy() const
+    {
+        return static_cast<bool>(completion);
+    }
+
+    /** @brief Get the host name used in the reports */
+    const std::string& getName() const
+    {
+        return name;
+    }
+
+    /** @brief Get the current chassis state */
+    const std::string& getChassisState() const
+    {
+        return currentChassisState;
+    }
+
+    /** @brief Get the current host state */
+    const std::string& getHostState() const
+    {
+        return currentHostState;
+    }
+
+    /** @brief Get the phases of the last operation */
+    const BootProfile& getProfile() const
+    {
+        return profile;
+    }
+
+    /** @brief Get the shared record of the last request */
+    const SharedRequest& getSharedRequest() const
+    {
+        return sharedRequest;
+    }
+
+    /**
+     * @brief Handle the host or chassis PropertiesChanged signal as if it
+     *        was received from the bus, used to benchmark the handling
+     *
+     * @param m - signal data, read from the beginning
+     */
+    void injectSignal(sdbusplus::message::message& m)
+    {
+        onPropertiesChanged(m);
+    }
+
+    /** @brief Get the signal handling statistics */
+    const SignalStats& getStats() const
+    {
+        return signalStats;
+    }
+
+  private:
+    using Timer = sdeventplus::utility::Timer<sdeventplus::ClockId::Monotonic>;
+
+    /**
+     * @brief Get the trace track name, the tracks of the host other than
+     *        the first one are prefixed with the host name
+     *
+     * @param what - tracked value
+     *
+     * @return track name
+     */
+    std::string track(const std::string& what) const;
+
+    /** @brief Get the path of the shared request record of the host */
+    std::string sharedRequestPath() const;
+
+    /**
+     * @brief Read the current states
+     *
+     * @param done  - completion handler
+     * @param retry - wait for the services and retry on failure
+     */
+    void readStates(std::function<void()>&& done, bool retry);
+
+    /**
+     * @brief Wait for the object mapper and the state managers within
+     *        the confirmation timeout and read the states again
+     *
+     * @param done - completion handler
+     */
+    void waitServices(std::function<void()>&& done);
+
+    /**
+     * @brief Call the refresh completion handler on the next event loop
+     *        iteration, out of the bus processing
+     *
+     * @param done - completion handler
+     */
+    void finishRefresh(std::function<void()>&& done);
+
+    /**
+     * @brief Start the operation reported to the journal
+     *
+     * @param operation - operation name
+     * @param done      - completion handler
+     */
+    void begin(const char* operation, Callback&& done);
+
+    /**
+     * @brief Start waiting for the expected states within the confirmation
+     *        timeout
+     *
+     * @param host    - expected host state, empty to ignore
+     * @param chassis - expected chassis state, empty to ignore
+     */
+    void expect(const std::string& host, const std::string& chassis);
+
+    /**
+     * @brief Restart the stall timer on the forward progress of the
+     *        operation in progress
+     *
+     * @param what - progress description for the flight recorder
+     */
+    void progress(const std::string& what);
+
+    /** @brief Complete the operation if the expected states are reached */
+    void checkExpectedState();
+
+    /** @brief Start watching the shared request record changes */
+    void watchSharedRequest();
+
+    /**
+     * @brief Complete the joined operation if the owner of the shared
+     *        request is finished or gone, fail the owned one if it is
+     *        replaced
+     */
+    void checkSharedRequest();
+
+    /**
+     * @brief Complete the operation, report it to the journal and call
+     *        the completion handler
+     *
+     * @param result - operation result
+     */
+    void complete(Result result);
+
+    /**
+     * @brief Report the operation event to the journal
+     *
+     * @param phase    - operation phase, null for the whole operation
+     * @param result   - phase or operation result
+     * @param duration - phase duration, the time since the operation start
+     *                   if omitted
+     */
+    void logOperation(const char* phase, const char* result,
+                      std::optional<std::chrono::microseconds> duration = {});
+
+    /** @brief Apply the state updates received since the last iteration */
+    void applyStateUpdates();
+
+    /**
+     * @brief PropertiesChanged signal handler of the host and chassis.
+     *        The new state is only stored here, it is applied by the idle
+     *        priority source when the bus queue is drained, so a burst of
+     *        signals is coalesced to the latest state per interface. Leaving
+     *        the expected state is noted per signal, the burst may return
+     *        to it.
+     *
+     * @param m - signal data
+     */
+    void onPropertiesChanged(sdbusplus::message::message& m);
+
+    /**
+     * @brief BootProgress, OperatingSystem.Status and POST code signal
+     *        handler
+     *
+     * @param m - signal data
+     */
+    void onBootProgress(sdbusplus::message::message& m);
+
+    sdbusplus::bus::bus& bus;
+    sdeventplus::Event event;
+
+    std::string name;
+    std::string chassisPath;
+    std::string hostPath;
+    std::string postCodePath;
+    std::string bootPath;
+    std::string bootOncePath;
+    std::string chassisService;
+    std::string hostService;
+    Property<std::string> chassisStateProperty;
+    Property<std::string> chassisTransitionProperty;
+    Property<std::string> hostStateProperty;
+    Property<std::string> hostTransitionProperty;
+
+    std::chrono::milliseconds confirmationTime{std::chrono::seconds(30)};
+    ServiceReadiness readiness;
+    std::chrono::steady_clock::duration readinessDelay{};
+    std::function<void()> refreshCompletion;
+    sdeventplus::source::Defer refreshDone;
+    bool waitOsReady = false;
+    bool osReady = false;
+    std::optional<BootOverride> bootOverride;
+
+    std::string currentChassisState, expectedChassisState;
+    std::string currentHostState, expectedHostState;
+
+    // State updates received but not yet applied
+    std::optional<std::string> pendingChassisState, pendingHostState;
+    sdeventplus::source::Defer stateUpdate;
+    StateHandler stateHandler;
+    SignalStats signalStats{};
+
+    // Operation in progress
+    const char* operationName = nullptr;
+    std::chrono::steady_clock::time_point operationStart;
+    Callback completion;
+    unsigned generation = 0;  // number of the operations started
+    bool sending = false;     // the request is being sent
+    bool restarting = false;  // the expected state is not left yet
+    bool warmRestart = false; // the chassis is expected to stay on
+    Timer confirmationTimer;
+    std::chrono::milliseconds stallTime{};
+    Timer stallTimer;
+    BootProfile profile;
+    SharedRequest sharedRequest;
+    std::optional<sdeventplus::source::IO> sharedRequestWatch;
+    std::optional<sdeventplus::source::IO> ownerWatch;
+    sdeventplus::source::Defer sharedRequestCheck;
+
+    std::vector<sdbusplus::bus::match::match> matches;
+
+    // Expires with the object, checked by the asynchronous reply handlers
+    std::shared_ptr<bool> lifetime = std::make_shared<bool>(true);
+};
+
+/**
+ * @brief Send the forced power off request to the chassis manager at once,
+ *        without the object mapper lookup, the state checks and the request
+ *        coordination. The object mapper is only asked if the request to the
+ *        given service fails.
+ *
+ * @param bus     - D-Bus connection
+ * @param index   - chassis index
+ * @param service - chassis manager service name, empty for the well-known
+ *                  name
+ * @param done    - completion handler, the argument is false on error
+ */
+void requestEmergencyOff(sdbusplus::bus::bus& bus, unsigned index,
+                         const std::string& service,
+                         std::function<void(bool)>&& done);
+
+} // namespace hostpwrctl
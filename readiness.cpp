@@ -0,0 +1,101 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#include "readiness.hpp"
+
+#include "dbus.hpp"
+#include "recorder.hpp"
+
+namespace hostpwrctl
+{
+
+ServiceReadiness::ServiceReadiness(sdbusplus::bus::bus& bus,
+                                   const sdeventplus::Event& event) :
+    bus(bus),
+    event(event)
+{}
+
+void ServiceReadiness::wait(const std::vector<std::string>& names,
+                            std::chrono::microseconds timeout,
+                            Callback&& done)
+{
+    completion = std::move(done);
+    missing.clear();
+    missing.insert(names.begin(), names.end());
+    matches.clear();
+
+    std::weak_ptr<bool> alive = lifetime;
+    for (const auto& name : missing)
+    {
+        // Subscribe first to not miss the name taken after the check
+        matches.emplace_back(
+            bus, sdbusplus::bus::match::rules::nameOwnerChanged(name),
+            [this](sdbusplus::message::message& m) {
+                std::string name, oldOwner, newOwner;
+                m.read(name, oldOwner, newOwner);
+                if (!newOwner.empty())
+                {
+                    onOwner(name);
+                }
+            });
+
+        auto method = bus.new_method_call(
+            "org.freedesktop.DBus", "/org/freedesktop/DBus",
+            "org.freedesktop.DBus", "NameHasOwner");
+        method.append(name);
+        callAsync(bus, method,
+                  [this, alive, name](sdbusplus::message::message& reply) {
+                      if (alive.expired() ||
+                          isReplyError(reply, "the name owner check"))
+                      {
+                          return;
+                      }
+                      bool hasOwner = false;
+                      reply.read(hasOwner);
+                      if (hasOwner)
+                      {
+                          onOwner(name);
+                      }
+                  });
+    }
+
+    if (timeout.count())
+    {
+        timer.emplace(event, [this](Timer&) { finish(false); });
+        timer->restartOnce(timeout);
+    }
+}
+
+void ServiceReadiness::onOwner(const std::string& name)
+{
+    if (missing.erase(name))
+    {
+        flightRecorder().record(FlightRecorder::Event::note, "%s is ready",
+                                name.c_str());
+        if (missing.empty())
+        {
+            finish(true);
+        }
+    }
+}
+
+void ServiceReadiness::finish(bool success)
+{
+    if (!completion)
+    {
+        return;
+    }
+    if (timer)
+    {
+        timer->setEnabled(false);
+    }
+
+    // The matches are kept, the handler may be running now
+    auto done = std::move(completion);
+    completion = nullptr;
+    done(success);
+}
+
+} // namespace hostpwrctl
@@ -0,0 +1,97 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#pragma once
+
+#include <sdbusplus/bus.hpp>
+#include <sdbusplus/bus/match.hpp>
+#include <sdeventplus/clock.hpp>
+#include <sdeventplus/event.hpp>
+#include <sdeventplus/utility/timer.hpp>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace hostpwrctl
+{
+
+/**
+ * @brief Waiting for the D-Bus services to appear.
+ *
+ *        Right after the BMC boot the object mapper and the state managers
+ *        may not be on the bus yet. The names are checked with NameHasOwner
+ *        and then tracked with the NameOwnerChanged signals, so the wait is
+ *        finished as soon as the last service takes its name.
+ */
+class ServiceReadiness
+{
+  public:
+    /** @brief Completion handler, the argument is false on timeout */
+    using Callback = std::function<void(bool)>;
+
+    /**
+     * @brief Constructor
+     *
+     * @param bus   - D-Bus connection attached to the event loop
+     * @param event - event loop
+     */
+    ServiceReadiness(sdbusplus::bus::bus& bus,
+                     const sdeventplus::Event& event);
+
+    ServiceReadiness(const ServiceReadiness&) = delete;
+    ServiceReadiness& operator=(const ServiceReadiness&) = delete;
+
+    /**
+     * @brief Wait for the services
+     *
+     * @param names   - well-known service names
+     * @param timeout - maximum time to wait, 0 to wait forever
+     * @param done    - completion handler
+     */
+    void wait(const std::vector<std::string>& names,
+              std::chrono::microseconds timeout, Callback&& done);
+
+    /**
+     * @brief Get the services which are not on the bus yet
+     */
+    const std::set<std::string>& getMissing() const
+    {
+        return missing;
+    }
+
+  private:
+    using Timer = sdeventplus::utility::Timer<sdeventplus::ClockId::Monotonic>;
+
+    /**
+     * @brief Handle the service appearance
+     *
+     * @param name - service name
+     */
+    void onOwner(const std::string& name);
+
+    /**
+     * @brief Finish the wait
+     *
+     * @param success - false on timeout
+     */
+    void finish(bool success);
+
+    sdbusplus::bus::bus& bus;
+    sdeventplus::Event event;
+    std::set<std::string> missing;
+    std::vector<sdbusplus::bus::match::match> matches;
+    std::optional<Timer> timer;
+    Callback completion;
+
+    // Expires with the object, checked by the asynchronous reply handlers
+    std::shared_ptr<bool> lifetime = std::make_shared<bool>(true);
+};
+
+} // namespace hostpwrctl
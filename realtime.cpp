@@ -0,0 +1,96 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#include "realtime.hpp"
+
+#include "recorder.hpp"
+
+#include <malloc.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace hostpwrctl
+{
+
+// Stack and heap reserved in advance, enough for the event loop handlers
+constexpr size_t stackReserve = 256 * 1024;
+constexpr size_t heapReserve = 1024 * 1024;
+
+/**
+ * @brief Touch the stack pages to fault them in while it is cheap
+ */
+static void prefaultStack()
+{
+    volatile char stack[stackReserve];
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < sizeof(stack); i += pageSize)
+    {
+        stack[i] = 0;
+    }
+}
+
+/**
+ * @brief Fault in the heap and keep it in the process,
+ *        so the later allocations do not hit the kernel
+ */
+static void prefaultHeap()
+{
+    // Allocations are served from the locked heap, not by mmap
+    mallopt(M_MMAP_MAX, 0);
+    mallopt(M_TRIM_THRESHOLD, -1);
+
+    char* heap = static_cast<char*>(malloc(heapReserve));
+    if (heap)
+    {
+        const long pageSize = sysconf(_SC_PAGESIZE);
+        for (size_t i = 0; i < heapReserve; i += pageSize)
+        {
+            heap[i] = 0;
+        }
+        free(heap);
+    }
+}
+
+bool enterRealtime(int priority)
+{
+    bool success = true;
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1)
+    {
+        fprintf(stderr, "Unable to lock the memory: %s\n", strerror(errno));
+        success = false;
+    }
+    prefaultStack();
+    prefaultHeap();
+
+    // The children (e.g. the hook scripts) do not inherit the policy
+    sched_param param{};
+    param.sched_priority = priority;
+    if (sched_setscheduler(0, SCHED_FIFO | SCHED_RESET_ON_FORK, &param) == -1)
+    {
+        fprintf(stderr, "Unable to set the real-time priority: %s\n",
+                strerror(errno));
+        success = false;
+        if (setpriority(PRIO_PROCESS, 0, -20) == -1)
+        {
+            fprintf(stderr, "Unable to set the nice level: %s\n",
+                    strerror(errno));
+        }
+    }
+
+    flightRecorder().record(FlightRecorder::Event::note,
+                            "real-time mode, priority %d%s", priority,
+                            success ? "" : " (partial)");
+    return success;
+}
+
+} // namespace hostpwrctl
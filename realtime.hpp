@@ -0,0 +1,31 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#pragma once
+
+namespace hostpwrctl
+{
+
+/**
+ * @brief Default SCHED_FIFO priority of the real-time mode
+ */
+constexpr int defaultRealtimePriority = 20;
+
+/**
+ * @brief Switch the process to the real-time mode to bound its latency on
+ *        the overloaded system: the memory is locked, so the process is not
+ *        paged out, the stack and the heap are pre-faulted and the process
+ *        is scheduled with SCHED_FIFO (or the highest nice level if the
+ *        real-time policy is not allowed). The child processes are started
+ *        with the normal policy.
+ *        The mode is best effort, the failed steps are reported and skipped.
+ *
+ * @param priority - SCHED_FIFO priority
+ *
+ * @return false if any step failed
+ */
+bool enterRealtime(int priority);
+
+} // namespace hostpwrctl
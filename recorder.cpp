@@ -0,0 +1,60 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#include "recorder.hpp"
+
+#include "util.hpp"
+
+#include <cstdarg>
+
+namespace hostpwrctl
+{
+
+void FlightRecorder::record(Event type, const char* fmt, ...)
+{
+    Entry& entry = ring[count % capacity];
+    ++count;
+
+    entry.time = monotonicNow();
+    entry.type = type;
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(entry.text, sizeof(entry.text), fmt, args);
+    va_end(args);
+}
+
+void FlightRecorder::dump(FILE* out) const
+{
+    static const char* typeNames[] = {"call",   "reply", "error",
+                                      "signal", "timer", "note"};
+
+    size_t first = count > capacity ? count - capacity : 0;
+    fprintf(out, "Flight recorder, %zu of %zu events:\n", count - first,
+            count);
+    if (first == count)
+    {
+        return;
+    }
+
+    uint64_t begin = ring[first % capacity].time;
+    for (size_t i = first; i < count; ++i)
+    {
+        const Entry& entry = ring[i % capacity];
+        uint64_t offset = entry.time - begin;
+        fprintf(out, "  %6llu.%06llu %-6s %s\n",
+                static_cast<unsigned long long>(offset / 1000000),
+                static_cast<unsigned long long>(offset % 1000000),
+                typeNames[static_cast<size_t>(entry.type)], entry.text);
+    }
+}
+
+FlightRecorder& flightRecorder()
+{
+    static FlightRecorder recorder;
+    return recorder;
+}
+
+} // namespace hostpwrctl
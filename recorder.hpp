@@ -0,0 +1,72 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+
+namespace hostpwrctl
+{
+
+/**
+ * @brief Flight recorder of the bus events.
+ *        The events are kept in the fixed size ring, recording never
+ *        allocates memory, the oldest events are overwritten. The ring is
+ *        dumped on failure or on request only.
+ */
+class FlightRecorder
+{
+  public:
+    static constexpr size_t capacity = 256;
+    static constexpr size_t textSize = 120;
+
+    /** @brief Event type */
+    enum class Event : uint8_t
+    {
+        call,   // method call sent
+        reply,  // method reply received
+        error,  // error reply received
+        signal, // signal received
+        timer,  // timer activity
+        note,   // other event
+    };
+
+    /**
+     * @brief Record the event
+     *
+     * @param type - event type
+     * @param fmt  - printf-like format of the event description
+     */
+    void record(Event type, const char* fmt, ...)
+        __attribute__((format(printf, 3, 4)));
+
+    /**
+     * @brief Print the recorded events, the oldest first
+     *
+     * @param out - output stream
+     */
+    void dump(FILE* out) const;
+
+  private:
+    /** @brief Recorded event */
+    struct Entry
+    {
+        uint64_t time; // CLOCK_MONOTONIC, us
+        Event type;
+        char text[textSize];
+    };
+
+    std::array<Entry, capacity> ring;
+    size_t count = 0;
+};
+
+/**
+ * @brief Get the process wide flight recorder
+ */
+FlightRecorder& flightRecorder();
+
+} // namespace hostpwrctl
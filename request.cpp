@@ -0,0 +1,262 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#include "request.hpp"
+
+#include "util.hpp"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace hostpwrctl
+{
+
+/**
+ * @brief Check if the process is still alive
+ *
+ * @param pid - process id
+ */
+static bool isAlive(pid_t pid)
+{
+    return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+SharedRequest::~SharedRequest()
+{
+    if (ownerFd != -1)
+    {
+        close(ownerFd);
+    }
+    if (watchFd != -1)
+    {
+        close(watchFd);
+    }
+    if (fd != -1)
+    {
+        close(fd);
+    }
+}
+
+SharedRequest::Status SharedRequest::claim(const char* path,
+                                           const char* operation,
+                                           bool preempt)
+{
+    filePath = path;
+    if (fd != -1)
+    {
+        // Claimed again by the long-running process
+        close(fd);
+        fd = -1;
+    }
+    if (ownerFd != -1)
+    {
+        close(ownerFd);
+        ownerFd = -1;
+    }
+
+    if (!createParentDir(path))
+    {
+        return Status::error;
+    }
+
+    fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1)
+    {
+        fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+        return Status::error;
+    }
+    if (flock(fd, LOCK_EX) == -1)
+    {
+        fprintf(stderr, "Unable to lock %s: %s\n", path, strerror(errno));
+        return Status::error;
+    }
+
+    Status status = Status::owner;
+    replacedOwner = 0;
+    if (load() && isAlive(getOwner()) && getOwner() != getpid())
+    {
+        if (0 ==
+            strncmp(record.operation, operation, sizeof(record.operation)))
+        {
+            status = Status::joined;
+        }
+        else
+        {
+            status = preempt ? Status::takenOver : Status::conflict;
+            if (preempt)
+            {
+                replacedOwner = getOwner();
+            }
+        }
+    }
+    if (status == Status::owner || status == Status::takenOver)
+    {
+        // The replaced owner does not store its result over ours
+        record = RequestRecord{};
+        record.owner = static_cast<uint32_t>(getpid());
+        record.started = monotonicNow();
+        strncpy(record.operation, operation, sizeof(record.operation) - 1);
+        owned = store();
+        if (!owned)
+        {
+            status = Status::error;
+        }
+    }
+
+    flock(fd, LOCK_UN);
+    return status;
+}
+
+std::string SharedRequest::getOperation() const
+{
+    return std::string(record.operation,
+                       strnlen(record.operation, sizeof(record.operation)));
+}
+
+int SharedRequest::watch()
+{
+    if (watchFd != -1)
+    {
+        return watchFd;
+    }
+
+    watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watchFd == -1 ||
+        inotify_add_watch(watchFd, filePath.c_str(), IN_MODIFY) == -1)
+    {
+        fprintf(stderr, "Unable to watch the request record: %s\n",
+                strerror(errno));
+        return -1;
+    }
+
+    return watchFd;
+}
+
+int SharedRequest::watchOwner()
+{
+    if (ownerFd != -1)
+    {
+        return ownerFd;
+    }
+
+    ownerFd = static_cast<int>(syscall(SYS_pidfd_open, getOwner(), 0));
+    if (ownerFd == -1)
+    {
+        fprintf(stderr, "Unable to watch the request owner: %s\n",
+                strerror(errno));
+    }
+
+    return ownerFd;
+}
+
+void SharedRequest::drainWatch()
+{
+    if (watchFd != -1)
+    {
+        // The record is reread anyway
+        char buf[sizeof(inotify_event) * 8];
+        while (read(watchFd, buf, sizeof(buf)) > 0)
+        {
+        }
+    }
+}
+
+std::optional<int> SharedRequest::getResult()
+{
+    drainWatch();
+
+    pid_t joined = getOwner();
+
+    flock(fd, LOCK_SH);
+    bool loaded = load();
+    flock(fd, LOCK_UN);
+
+    if (!loaded)
+    {
+        return std::nullopt;
+    }
+    if (record.owner == 0)
+    {
+        return record.result;
+    }
+    if (getOwner() != joined || !isAlive(joined))
+    {
+        // The owner has gone without storing the result
+        return EXIT_FAILURE;
+    }
+
+    return std::nullopt;
+}
+
+bool SharedRequest::isReplaced()
+{
+    drainWatch();
+    if (!owned)
+    {
+        return false;
+    }
+
+    flock(fd, LOCK_SH);
+    bool loaded = load();
+    flock(fd, LOCK_UN);
+
+    if (!loaded || getOwner() == getpid())
+    {
+        return false;
+    }
+    owned = false;
+    return true;
+}
+
+void SharedRequest::finish(int result)
+{
+    if (!owned)
+    {
+        return;
+    }
+    owned = false;
+
+    flock(fd, LOCK_EX);
+    if (load() && getOwner() == getpid())
+    {
+        record.owner = 0;
+        record.result = result;
+        store();
+    }
+    flock(fd, LOCK_UN);
+}
+
+bool SharedRequest::load()
+{
+    RequestRecord data;
+    if (pread(fd, &data, sizeof(data), 0) != sizeof(data))
+    {
+        return false;
+    }
+    record = data;
+    return true;
+}
+
+bool SharedRequest::store()
+{
+    if (pwrite(fd, &record, sizeof(record), 0) != sizeof(record))
+    {
+        fprintf(stderr, "Unable to write the request record: %s\n",
+                strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+} // namespace hostpwrctl
@@ -0,0 +1,155 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace hostpwrctl
+{
+
+/**
+ * @brief Layout of the shared power request record
+ */
+struct RequestRecord
+{
+    static constexpr size_t operationSize = 16;
+
+    uint32_t owner;   // PID of the process sent the request, 0 if finished
+    int32_t result;   // exit code of the finished request
+    uint64_t started; // CLOCK_MONOTONIC time of the request, us
+    char operation[operationSize];
+};
+
+/**
+ * @brief Power request shared between the concurrent invocations.
+ *
+ *        The record is protected with the file lock, the process which
+ *        claimed the record sends the request, the others with the same
+ *        operation join it and wait for its completion. The overriding
+ *        operation (the forced power off) takes the record over from
+ *        the other one, the joiners of the replaced request fail.
+ */
+class SharedRequest
+{
+  public:
+    static constexpr auto defaultPath = "/run/hostpwrctl/request";
+
+    /** @brief Result of the claim */
+    enum class Status
+    {
+        owner,     // the record is ours, the request must be sent
+        joined,    // the same request is in progress
+        conflict,  // other request is in progress
+        takenOver, // the record is ours, other request is replaced
+        error,     // the record is not available
+    };
+
+    SharedRequest() = default;
+    SharedRequest(const SharedRequest&) = delete;
+    SharedRequest& operator=(const SharedRequest&) = delete;
+    ~SharedRequest();
+
+    /**
+     * @brief Claim the record for the operation
+     *
+     * @param path      - record file path
+     * @param operation - operation name
+     * @param preempt   - take the record over from the other operation
+     *                    in progress instead of the conflict
+     *
+     * @return claim status
+     */
+    Status claim(const char* path, const char* operation,
+                 bool preempt = false);
+
+    /**
+     * @brief Get the in-flight request owner
+     *
+     * @return PID of the owner
+     */
+    pid_t getOwner() const
+    {
+        return static_cast<pid_t>(record.owner);
+    }
+
+    /**
+     * @brief Get the in-flight request operation
+     *
+     * @return operation name
+     */
+    std::string getOperation() const;
+
+    /**
+     * @brief Get the owner of the request replaced by the last claim
+     *
+     * @return PID of the replaced owner, 0 if nothing is replaced
+     */
+    pid_t getReplacedOwner() const
+    {
+        return replacedOwner;
+    }
+
+    /**
+     * @brief Get the inotify descriptor signaling the record changes
+     *
+     * @return file descriptor or -1 on error
+     */
+    int watch();
+
+    /**
+     * @brief Get the pidfd signaling the exit of the in-flight request owner,
+     *        e.g. killed without storing the result
+     *
+     * @return file descriptor or -1 on error
+     */
+    int watchOwner();
+
+    /**
+     * @brief Get the result of the joined request
+     *
+     * @return exit code of the owner if the request is finished
+     */
+    std::optional<int> getResult();
+
+    /**
+     * @brief Check if the owned request is taken over by another process,
+     *        the record is released then
+     *
+     * @return true if the request is replaced
+     */
+    bool isReplaced();
+
+    /**
+     * @brief Store the result of the owned request and release the record
+     *
+     * @param result - exit code
+     */
+    void finish(int result);
+
+  private:
+    /** @brief Drain the pending record change notifications */
+    void drainWatch();
+
+    /** @brief Read the record, the lock must be held */
+    bool load();
+
+    /** @brief Write the record, the lock must be held */
+    bool store();
+
+    std::string filePath;
+    int fd = -1;
+    int watchFd = -1;
+    int ownerFd = -1;
+    bool owned = false;
+    pid_t replacedOwner = 0;
+    RequestRecord record{};
+};
+
+} // namespace hostpwrctl
@@ -0,0 +1,373 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#include "sequencer.hpp"
+
+#include "dbus.hpp"
+#include "journal.hpp"
+#include "state.hpp"
+#include "trace.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+
+namespace hostpwrctl
+{
+
+const Sequencer::Kind Sequencer::kinds[] = {
+    {"host", hostIface, hostState, hostTransition, hostTransitionOn,
+     hostTransitionOff, hostStateOn, hostStateOff},
+    {"chassis", chassisIface, chassisState, chassisTransition,
+     chassisTransitionOn, chassisTransitionOff, chassisStateOn,
+     chassisStateOff},
+};
+
+Sequencer::Sequencer(sdbusplus::bus::bus& bus, bool powerOn,
+                     Callback&& done) :
+    bus(bus),
+    powerOn(powerOn), done(std::move(done))
+{}
+
+bool Sequencer::load(const char* path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return false;
+    }
+
+    std::string line;
+    size_t lineNum = 0;
+    while (std::getline(file, line))
+    {
+        ++lineNum;
+        line.resize(std::min(line.find('#'), line.size()));
+
+        std::istringstream tokens(line);
+        std::string name, kind, objPath;
+        if (!(tokens >> name))
+        {
+            continue;
+        }
+        if (!(tokens >> kind >> objPath))
+        {
+            fprintf(stderr, "%s:%zu: object type and path expected\n", path,
+                    lineNum);
+            return false;
+        }
+
+        auto kindIt = std::find_if(
+            std::begin(kinds), std::end(kinds),
+            [&kind](const Kind& item) { return kind == item.name; });
+        if (kindIt == std::end(kinds))
+        {
+            fprintf(stderr, "%s:%zu: unknown object type '%s'\n", path,
+                    lineNum, kind.c_str());
+            return false;
+        }
+        if (std::any_of(nodes.begin(), nodes.end(), [&name](const Node& node) {
+                return node.name == name;
+            }))
+        {
+            fprintf(stderr, "%s:%zu: duplicate object '%s'\n", path, lineNum,
+                    name.c_str());
+            return false;
+        }
+
+        Node node{};
+        node.name = std::move(name);
+        node.kind = &*kindIt;
+        node.path = std::move(objPath);
+        std::string dependency;
+        while (tokens >> dependency)
+        {
+            node.dependencies.push_back(std::move(dependency));
+        }
+        nodes.push_back(std::move(node));
+    }
+
+    if (nodes.empty())
+    {
+        fprintf(stderr, "%s: no objects defined\n", path);
+        return false;
+    }
+
+    std::map<std::string, size_t> indexes;
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        indexes[nodes[i].name] = i;
+    }
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        for (const auto& dependency : nodes[i].dependencies)
+        {
+            auto it = indexes.find(dependency);
+            if (it == indexes.end())
+            {
+                fprintf(stderr, "%s: unknown dependency '%s' of '%s'\n", path,
+                        dependency.c_str(), nodes[i].name.c_str());
+                return false;
+            }
+            // Dependencies go first on power on and last on power off
+            if (powerOn)
+            {
+                nodes[i].predecessors.push_back(it->second);
+            }
+            else
+            {
+                nodes[it->second].predecessors.push_back(i);
+            }
+        }
+    }
+
+    if (!isAcyclic())
+    {
+        fprintf(stderr, "%s: circular dependency\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+bool Sequencer::isAcyclic() const
+{
+    // Kahn's algorithm: all the nodes must be sorted topologically
+    std::vector<size_t> degree(nodes.size());
+    std::vector<std::vector<size_t>> successors(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        degree[i] = nodes[i].predecessors.size();
+        for (auto pred : nodes[i].predecessors)
+        {
+            successors[pred].push_back(i);
+        }
+    }
+
+    std::vector<size_t> ready;
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        if (!degree[i])
+        {
+            ready.push_back(i);
+        }
+    }
+
+    size_t sorted = 0;
+    while (!ready.empty())
+    {
+        auto i = ready.back();
+        ready.pop_back();
+        ++sorted;
+        for (auto succ : successors[i])
+        {
+            if (!--degree[succ])
+            {
+                ready.push_back(succ);
+            }
+        }
+    }
+
+    return sorted == nodes.size();
+}
+
+const char* Sequencer::getTarget(const Node& node) const
+{
+    return powerOn ? node.kind->stateOn : node.kind->stateOff;
+}
+
+void Sequencer::start()
+{
+    started = Clock::now();
+
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        matches.emplace_back(
+            bus,
+            sdbusplus::bus::match::rules::propertiesChanged(
+                nodes[i].path, nodes[i].kind->iface),
+            [this, i](sdbusplus::message::message& m) {
+                std::string iface;
+                std::map<std::string, std::variant<std::string, uint64_t>>
+                    data;
+                std::vector<std::string> v;
+                m.read(iface, data, v);
+
+                auto it = data.find(nodes[i].kind->state);
+                if (it != data.end())
+                {
+                    auto state = std::get_if<std::string>(&it->second);
+                    if (state)
+                    {
+                        onStateChanged(i, *state);
+                    }
+                }
+            });
+    }
+
+    // Get the current states in one batch
+    std::vector<std::pair<std::string, std::string>> objects;
+    for (const auto& node : nodes)
+    {
+        objects.emplace_back(node.path, node.kind->iface);
+    }
+    resolveServices(bus, objects);
+
+    auto pending = std::make_shared<size_t>(0);
+    std::vector<std::shared_ptr<std::optional<std::string>>> states;
+    for (const auto& node : nodes)
+    {
+        states.push_back(std::make_shared<std::optional<std::string>>());
+        requestProperty(bus,
+                        Property<std::string>{node.path.c_str(),
+                                              node.kind->iface,
+                                              node.kind->state},
+                        states.back(), pending);
+    }
+    waitReplies(bus, *pending);
+
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        auto& node = nodes[i];
+        if (*states[i] && node.state.empty())
+        {
+            node.state = std::move(**states[i]);
+            tracer().state(node.name, trimClassName(node.state));
+        }
+        if (node.status == Status::waiting && node.state == getTarget(node))
+        {
+            node.status = Status::skipped;
+            node.started = node.finished = started;
+        }
+    }
+
+    advance();
+}
+
+void Sequencer::advance()
+{
+    if (finished)
+    {
+        return;
+    }
+
+    bool complete = true;
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        auto& node = nodes[i];
+        if (node.status == Status::waiting &&
+            std::all_of(node.predecessors.begin(), node.predecessors.end(),
+                        [this](size_t pred) {
+                            return nodes[pred].status == Status::done ||
+                                   nodes[pred].status == Status::skipped;
+                        }))
+        {
+            request(i);
+        }
+        complete = complete && (node.status == Status::done ||
+                                node.status == Status::skipped);
+    }
+
+    if (complete)
+    {
+        finish(true);
+    }
+}
+
+void Sequencer::request(size_t index)
+{
+    auto& node = nodes[index];
+    node.status = Status::requested;
+    node.started = Clock::now();
+
+    printf("Power %s request was sent to %s.\n", powerOn ? "on" : "off",
+           node.name.c_str());
+
+    setProperty(bus,
+                Property<std::string>{node.path.c_str(), node.kind->iface,
+                                      node.kind->transition},
+                std::string(powerOn ? node.kind->transitionOn
+                                    : node.kind->transitionOff),
+                [this, index](bool success) {
+                    if (!success)
+                    {
+                        auto& node = nodes[index];
+                        node.status = Status::failed;
+                        node.finished = Clock::now();
+                        logNode(node, "failed");
+                        finish(false);
+                    }
+                });
+}
+
+void Sequencer::onStateChanged(size_t index, const std::string& state)
+{
+    auto& node = nodes[index];
+    node.state = state;
+    tracer().state(node.name, trimClassName(state));
+
+    if ((node.status == Status::waiting || node.status == Status::requested) &&
+        state == getTarget(node))
+    {
+        if (node.status == Status::waiting)
+        {
+            // Reached without our request
+            node.started = Clock::now();
+        }
+        node.status = Status::done;
+        node.finished = Clock::now();
+        printf("%s reached the target state in %.3f s.\n", node.name.c_str(),
+               toSeconds(node.finished - node.started));
+        logNode(node, "done");
+        advance();
+    }
+}
+
+void Sequencer::logNode(const Node& node, const char* result) const
+{
+    logEvent({node.name.c_str(), powerOn ? "on" : "off", "Transition", result,
+              std::chrono::duration_cast<std::chrono::microseconds>(
+                  node.finished - node.started)});
+}
+
+void Sequencer::finish(bool success)
+{
+    if (finished)
+    {
+        return;
+    }
+    finished = true;
+    done(success);
+}
+
+void Sequencer::report(FILE* out) const
+{
+    static const char* statusNames[] = {"waiting", "requested", "done",
+                                        "skipped", "failed"};
+
+    fprintf(out, "  %-16s %-8s %-10s %10s %12s\n", "Object", "Type", "Result",
+            "Start, s", "Duration, s");
+    for (const auto& node : nodes)
+    {
+        fprintf(out, "  %-16s %-8s %-10s", node.name.c_str(),
+                node.kind->name,
+                statusNames[static_cast<size_t>(node.status)]);
+        if (node.status == Status::waiting)
+        {
+            fprintf(out, "\n");
+            continue;
+        }
+        auto end = node.status == Status::requested ? Clock::now()
+                                                    : node.finished;
+        fprintf(out, " %10.3f %12.3f\n", toSeconds(node.started - started),
+                toSeconds(end - node.started));
+    }
+}
+
+} // namespace hostpwrctl
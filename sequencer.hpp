@@ -0,0 +1,145 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#pragma once
+
+#include <sdbusplus/bus.hpp>
+#include <sdbusplus/bus/match.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace hostpwrctl
+{
+
+/**
+ * @brief Power sequencer of the dependent hosts and chassis.
+ *
+ *        The objects and their dependencies are described in the text
+ *        file, one object per line:
+ *          <name> <host|chassis> <object path> [dependency names...]
+ *        When powering on, the object transition is requested as soon as
+ *        all its dependencies are on. When powering off, the order is
+ *        reversed: the object is turned off after all the objects depending
+ *        on it are off. Independent objects are handled in parallel.
+ *        Host objects are switched with RequestedHostTransition (so the
+ *        power off is graceful), chassis objects with
+ *        RequestedPowerTransition.
+ */
+class Sequencer
+{
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    /** @brief Completion handler, the argument is false on failure */
+    using Callback = std::function<void(bool)>;
+
+    /**
+     * @brief Constructor
+     *
+     * @param bus     - D-Bus connection attached to the event loop
+     * @param powerOn - power on if true, off otherwise
+     * @param done    - completion handler
+     */
+    Sequencer(sdbusplus::bus::bus& bus, bool powerOn, Callback&& done);
+
+    Sequencer(const Sequencer&) = delete;
+    Sequencer& operator=(const Sequencer&) = delete;
+
+    /**
+     * @brief Load the dependency graph
+     *
+     * @param path - description file path
+     *
+     * @return false if the description is invalid
+     */
+    bool load(const char* path);
+
+    /**
+     * @brief Get the current states and start the sequence
+     */
+    void start();
+
+    /**
+     * @brief Print the per-object report
+     *
+     * @param out - output stream
+     */
+    void report(FILE* out) const;
+
+  private:
+    /** @brief D-Bus details of the object type */
+    struct Kind
+    {
+        const char* name;
+        const char* iface;
+        const char* state;
+        const char* transition;
+        const char* transitionOn;
+        const char* transitionOff;
+        const char* stateOn;
+        const char* stateOff;
+    };
+
+    /** @brief Object status */
+    enum class Status
+    {
+        waiting,   // waiting for the predecessors
+        requested, // transition is requested
+        done,      // target state reached
+        skipped,   // target state was reached before the sequence
+        failed,    // transition request failed
+    };
+
+    /** @brief Sequenced object */
+    struct Node
+    {
+        std::string name;
+        const Kind* kind;
+        std::string path;
+        std::vector<std::string> dependencies;
+        std::vector<size_t> predecessors;
+        Status status;
+        std::string state;
+        Clock::time_point started;
+        Clock::time_point finished;
+    };
+
+    static const Kind kinds[];
+
+    /** @brief Check that the graph has no cycles */
+    bool isAcyclic() const;
+
+    /** @brief Get the target state of the node */
+    const char* getTarget(const Node& node) const;
+
+    /** @brief Request transitions of the nodes with completed predecessors */
+    void advance();
+
+    /** @brief Request the node transition */
+    void request(size_t index);
+
+    /** @brief Handle the node state change */
+    void onStateChanged(size_t index, const std::string& state);
+
+    /** @brief Report the node transition result to the journal */
+    void logNode(const Node& node, const char* result) const;
+
+    /** @brief Complete the sequence */
+    void finish(bool success);
+
+    sdbusplus::bus::bus& bus;
+    bool powerOn;
+    Callback done;
+    bool finished = false;
+    Clock::time_point started;
+    std::vector<Node> nodes;
+    std::vector<sdbusplus::bus::match::match> matches;
+};
+
+} // namespace hostpwrctl
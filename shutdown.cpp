@@ -0,0 +1,166 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#include "shutdown.hpp"
+
+#include "dbus.hpp"
+#include "recorder.hpp"
+#include "state.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace hostpwrctl
+{
+
+RackShutdown::RackShutdown(sdbusplus::bus::bus& bus,
+                           const sdeventplus::Event& event,
+                           std::chrono::milliseconds deadline,
+                           std::chrono::milliseconds margin,
+                           Callback&& done) :
+    bus(bus),
+    event(event), deadline(deadline), margin(margin),
+    completion(std::move(done))
+{}
+
+void RackShutdown::start()
+{
+    started = Clock::now();
+
+    auto method = bus.new_method_call(
+        "xyz.openbmc_project.ObjectMapper",
+        "/xyz/openbmc_project/object_mapper",
+        "xyz.openbmc_project.ObjectMapper", "GetSubTreePaths");
+    method.append("/xyz/openbmc_project/state", 0,
+                  std::vector<std::string>{hostIface});
+
+    auto onReply = [this](sdbusplus::message::message& reply) {
+        std::vector<unsigned> indexes;
+        if (!isReplyError(reply, "the host lookup"))
+        {
+            std::vector<std::string> paths;
+            reply.read(paths);
+
+            const size_t prefixLength = strlen(hostPathPrefix);
+            for (const auto& path : paths)
+            {
+                if (path.compare(0, prefixLength, hostPathPrefix) != 0 ||
+                    path.size() == prefixLength)
+                {
+                    continue;
+                }
+                char* end;
+                unsigned long index =
+                    strtoul(path.c_str() + prefixLength, &end, 10);
+                if (!*end)
+                {
+                    indexes.push_back(static_cast<unsigned>(index));
+                }
+            }
+        }
+        if (indexes.empty())
+        {
+            fprintf(stderr, "No hosts found\n");
+            completion(false);
+            return;
+        }
+        std::sort(indexes.begin(), indexes.end());
+        shutdownHosts(indexes);
+    };
+    if (!callAsync(bus, method, std::move(onReply)))
+    {
+        completion(false);
+    }
+}
+
+void RackShutdown::shutdownHosts(const std::vector<unsigned>& indexes)
+{
+    hosts.reserve(indexes.size());
+    for (unsigned index : indexes)
+    {
+        hosts.push_back({std::make_unique<PowerControl>(bus, event, index),
+                         Path::pending, {}});
+    }
+
+    // The state reads of all the hosts are sent at once
+    remaining = hosts.size();
+    for (auto& host : hosts)
+    {
+        // The missing state manager is not waited longer than the deadline
+        host.power->setTimeout(
+            std::max(deadline - margin, std::chrono::milliseconds(1)));
+        host.power->refresh([this, &host]() { spawn(shutdownHost(host)); });
+    }
+}
+
+Task<> RackShutdown::shutdownHost(Host& host)
+{
+    auto& power = *host.power;
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        Clock::now() - started);
+
+    if (power.getChassisState() == chassisStateOff)
+    {
+        host.path = Path::already;
+    }
+    else
+    {
+        // The graceful shutdown is waited until the deadline minus margin
+        auto softTime = std::max(deadline - margin - elapsed,
+                                 std::chrono::milliseconds(1));
+        // The elapsed time includes the wait for the services already
+        power.clearReadinessDelay();
+        power.setTimeout(softTime);
+        auto result = co_await power.run(PowerControl::Operation::soft);
+        if (result == PowerControl::Result::success)
+        {
+            host.path = Path::soft;
+        }
+        else
+        {
+            flightRecorder().record(FlightRecorder::Event::note,
+                                    "%s: forced off", power.getName().c_str());
+            power.setTimeout(margin);
+            result = co_await power.run(PowerControl::Operation::off);
+            host.path = result == PowerControl::Result::success
+                            ? Path::forced
+                            : Path::failed;
+        }
+    }
+    host.duration = Clock::now() - started;
+
+    if (--remaining == 0)
+    {
+        bool success =
+            std::none_of(hosts.begin(), hosts.end(), [](const Host& host) {
+                return host.path == Path::failed;
+            });
+        completion(success);
+    }
+}
+
+void RackShutdown::report(FILE* out) const
+{
+    const char* paths[] = {"pending", "already off", "soft off",
+                           "forced off", "failed"};
+    for (const auto& host : hosts)
+    {
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      host.duration)
+                      .count();
+        fprintf(out, "%s: %s", host.power->getName().c_str(),
+                paths[static_cast<size_t>(host.path)]);
+        if (host.path != Path::pending && host.path != Path::already)
+        {
+            fprintf(out, " in %lld.%03lld s", static_cast<long long>(ms / 1000),
+                    static_cast<long long>(ms % 1000));
+        }
+        fprintf(out, "\n");
+    }
+}
+
+} // namespace hostpwrctl
@@ -0,0 +1,113 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#pragma once
+
+#include "coroutine.hpp"
+#include "powercontrol.hpp"
+
+#include <sdbusplus/bus.hpp>
+#include <sdeventplus/event.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace hostpwrctl
+{
+
+/**
+ * @brief Shutdown of all the hosts within the global deadline,
+ *        e.g. on the facility power loss while running on the UPS.
+ *
+ *        The hosts are found with the object mapper and gracefully turned
+ *        off in parallel. The host which is not off when the deadline minus
+ *        the safety margin arrives, or refuses the graceful shutdown, is
+ *        turned off with the forced chassis power off which must complete
+ *        within the margin.
+ */
+class RackShutdown
+{
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    /** @brief Completion handler, the argument is false if any host failed */
+    using Callback = std::function<void(bool)>;
+
+    /**
+     * @brief Constructor
+     *
+     * @param bus      - D-Bus connection attached to the event loop
+     * @param event    - event loop
+     * @param deadline - time all the hosts must be off in
+     * @param margin   - time reserved for the forced power off
+     * @param done     - completion handler
+     */
+    RackShutdown(sdbusplus::bus::bus& bus, const sdeventplus::Event& event,
+                 std::chrono::milliseconds deadline,
+                 std::chrono::milliseconds margin, Callback&& done);
+
+    RackShutdown(const RackShutdown&) = delete;
+    RackShutdown& operator=(const RackShutdown&) = delete;
+
+    /**
+     * @brief Find the hosts and start the shutdown
+     */
+    void start();
+
+    /**
+     * @brief Print the per-host report
+     *
+     * @param out - output stream
+     */
+    void report(FILE* out) const;
+
+  private:
+    /** @brief The way the host is turned off */
+    enum class Path
+    {
+        pending, // shutdown is in progress
+        already, // the host was off
+        soft,    // gracefully turned off
+        forced,  // turned off with the forced chassis power off
+        failed,  // the host is not off
+    };
+
+    /** @brief Host shutdown state */
+    struct Host
+    {
+        std::unique_ptr<PowerControl> power;
+        Path path;
+        Clock::duration duration;
+    };
+
+    /**
+     * @brief Create the power control of the found hosts and start
+     *        the shutdown of each one
+     *
+     * @param indexes - host indexes
+     */
+    void shutdownHosts(const std::vector<unsigned>& indexes);
+
+    /**
+     * @brief Turn the host off, the graceful way first
+     *
+     * @param host - host to turn off
+     */
+    Task<> shutdownHost(Host& host);
+
+    sdbusplus::bus::bus& bus;
+    sdeventplus::Event event;
+    std::chrono::milliseconds deadline;
+    std::chrono::milliseconds margin;
+    Callback completion;
+    Clock::time_point started;
+    std::vector<Host> hosts;
+    size_t remaining = 0;
+};
+
+} // namespace hostpwrctl
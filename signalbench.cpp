@@ -0,0 +1,217 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+/*
+ * Signal storm benchmark.
+ *
+ * Synthetic PropertiesChanged signals of the host and the chassis are fed
+ * to PowerControl at the fixed rate from the periodic timer, so they come
+ * in bursts between the event loop iterations, as the bus delivers them
+ * during the PSU events. The backlog is the number of the signals which
+ * are due but not handled yet when the timer fires, it grows when the
+ * handling does not keep up with the rate.
+ */
+
+#include "dbus.hpp"
+#include "powercontrol.hpp"
+#include "state.hpp"
+#include "util.hpp"
+
+#include <getopt.h>
+#include <systemd/sd-bus.h>
+
+#include <sdbusplus/bus.hpp>
+#include <sdeventplus/clock.hpp>
+#include <sdeventplus/event.hpp>
+#include <sdeventplus/utility/timer.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <variant>
+#include <vector>
+
+using namespace hostpwrctl;
+
+constexpr unsigned defaultRate = 100000;
+constexpr unsigned defaultDuration = 5;
+
+/** @brief Host index of the synthetic signals, not used by the real ones */
+constexpr unsigned benchIndex = 99;
+
+/** @brief Number of the prepared signals, they are reused in turn */
+constexpr size_t poolSize = 1024;
+
+using Timer = sdeventplus::utility::Timer<sdeventplus::ClockId::Monotonic>;
+
+/**
+ * @brief Build the sealed PropertiesChanged signal ready for reading
+ *
+ * @param bus      - D-Bus connection
+ * @param path     - object path
+ * @param iface    - changed interface
+ * @param property - changed property
+ * @param value    - new value
+ * @param cookie   - message cookie
+ *
+ * @return signal message
+ */
+static sdbusplus::message::message
+    makeSignal(sdbusplus::bus::bus& bus, const std::string& path,
+               const char* iface, const char* property,
+               const std::string& value, uint64_t cookie)
+{
+    auto m = bus.new_signal(path.c_str(), ifaceDBusProperties,
+                            "PropertiesChanged");
+    std::map<std::string, std::variant<std::string>> data{{property, value}};
+    m.append(iface, data, std::vector<std::string>());
+    sd_bus_message_seal(m.get(), cookie, 0);
+    return m;
+}
+
+/**
+ * @brief Show the usage
+ *
+ * @param app - application name
+ */
+static void showUsage(const char* app)
+{
+    printf(R"(Usage: %s [options]
+Flood the power control with the synthetic state change signals and report
+the handling throughput, the backlog and the coalescing.
+  -r, --rate N       signals per second (default: %u)
+  -d, --duration SEC benchmark duration (default: %u)
+  -h, --help         show this help
+)",
+           app, defaultRate, defaultDuration);
+}
+
+/**
+ * @brief Application entry point
+ */
+int main(int argc, char* argv[])
+{
+    unsigned rate = defaultRate;
+    unsigned duration = defaultDuration;
+
+    const struct option opts[] = {
+        {"rate", required_argument, nullptr, 'r'},
+        {"duration", required_argument, nullptr, 'd'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "r:d:h", opts, nullptr)) != -1)
+    {
+        switch (opt)
+        {
+            case 'r':
+                if (!parseUnsigned(optarg, rate) || !rate)
+                {
+                    fprintf(stderr, "Invalid rate: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'd':
+                if (!parseUnsigned(optarg, duration) || !duration)
+                {
+                    fprintf(stderr, "Invalid duration: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'h':
+                showUsage(argv[0]);
+                return EXIT_SUCCESS;
+            default:
+                showUsage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    auto bus = sdbusplus::bus::new_default();
+    auto event = sdeventplus::Event::get_default();
+    bus.attach_event(event.get(), SD_EVENT_PRIORITY_NORMAL);
+
+    PowerControl power(bus, event, benchIndex);
+    size_t updates = 0;
+    power.onStateChange(
+        [&updates](const std::string&, const std::string&) { ++updates; });
+
+    // Every state changes on each signal of its kind, so nothing is
+    // dropped as a repetition
+    static const char* const hostStates[] = {hostStateOff, hostStateOn};
+    static const char* const chassisStates[] = {chassisStateOff,
+                                                chassisStateOn};
+    std::string hostObject = hostPathPrefix + std::to_string(benchIndex);
+    std::string chassisObject =
+        chassisPathPrefix + std::to_string(benchIndex);
+    std::vector<sdbusplus::message::message> pool;
+    pool.reserve(poolSize);
+    for (size_t i = 0; i < poolSize; ++i)
+    {
+        if (i % 2)
+        {
+            pool.push_back(makeSignal(bus, hostObject, hostIface, hostState,
+                                      hostStates[(i / 2) % 2], i + 1));
+        }
+        else
+        {
+            pool.push_back(makeSignal(bus, chassisObject, chassisIface,
+                                      chassisState,
+                                      chassisStates[(i / 2) % 2], i + 1));
+        }
+    }
+
+    const uint64_t total = static_cast<uint64_t>(rate) * duration;
+    uint64_t injected = 0;
+    uint64_t maxBacklog = 0;
+    uint64_t handling = 0; // time spent in the handler, us
+    uint64_t start = monotonicNow();
+
+    Timer timer(
+        event,
+        [&](Timer&) {
+            uint64_t now = monotonicNow();
+            uint64_t due = std::min(total, (now - start) * rate / 1000000);
+            if (due > injected)
+            {
+                maxBacklog = std::max(maxBacklog, due - injected);
+            }
+            for (; injected < due; ++injected)
+            {
+                auto& m = pool[injected % poolSize];
+                sd_bus_message_rewind(m.get(), true);
+                power.injectSignal(m);
+            }
+            handling += monotonicNow() - now;
+            if (injected == total)
+            {
+                event.exit(EXIT_SUCCESS);
+            }
+        },
+        std::chrono::milliseconds(1));
+
+    int rc = event.loop();
+    uint64_t elapsed = monotonicNow() - start;
+
+    const auto& stats = power.getStats();
+    double seconds = elapsed / 1e6;
+    printf("Signals injected: %llu in %.3f s (%.0f/s, target %u/s)\n",
+           static_cast<unsigned long long>(injected), seconds,
+           injected / seconds, rate);
+    printf("Handler time: %.3f s, %.0f ns per signal, capacity %.0f/s\n",
+           handling / 1e6, injected ? handling * 1e3 / injected : 0.0,
+           handling ? injected * 1e6 / handling : 0.0);
+    printf("Max backlog: %llu signals\n",
+           static_cast<unsigned long long>(maxBacklog));
+    printf("Signals received: %zu, state updates applied: %zu, "
+           "coalesced: %zu, handled: %zu\n",
+           stats.received, stats.applied, stats.coalesced, updates);
+
+    return rc;
+}
@@ -0,0 +1,123 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#pragma once
+
+#include "dbus.hpp"
+
+#include <cstdint>
+#include <string>
+
+namespace hostpwrctl
+{
+
+constexpr auto mapperService = "xyz.openbmc_project.ObjectMapper";
+
+// Well-known names of the state managers, the index is appended unless 0
+constexpr auto chassisServicePrefix = "xyz.openbmc_project.State.Chassis";
+constexpr auto hostServicePrefix = "xyz.openbmc_project.State.Host";
+
+constexpr auto chassisPathPrefix = "/xyz/openbmc_project/state/chassis";
+constexpr auto chassisPath = "/xyz/openbmc_project/state/chassis0";
+constexpr auto chassisIface = "xyz.openbmc_project.State.Chassis";
+constexpr auto chassisState = "CurrentPowerState";
+constexpr auto chassisStateOn =
+    "xyz.openbmc_project.State.Chassis.PowerState.On";
+constexpr auto chassisStateOff =
+    "xyz.openbmc_project.State.Chassis.PowerState.Off";
+constexpr auto chassisTransition = "RequestedPowerTransition";
+constexpr auto chassisTransitionOn =
+    "xyz.openbmc_project.State.Chassis.Transition.On";
+constexpr auto chassisTransitionOff =
+    "xyz.openbmc_project.State.Chassis.Transition.Off";
+constexpr auto chassisTransitionPowerCycle =
+    "xyz.openbmc_project.State.Chassis.Transition.PowerCycle";
+
+constexpr auto chassisStatePrefix =
+    "xyz.openbmc_project.State.Chassis.PowerState.";
+
+constexpr auto hostPathPrefix = "/xyz/openbmc_project/state/host";
+constexpr auto hostName = "host0";
+constexpr auto hostPath = "/xyz/openbmc_project/state/host0";
+constexpr auto hostIface = "xyz.openbmc_project.State.Host";
+constexpr auto hostState = "CurrentHostState";
+constexpr auto hostStateOn = "xyz.openbmc_project.State.Host.HostState.Running";
+constexpr auto hostStateOff = "xyz.openbmc_project.State.Host.HostState.Off";
+constexpr auto hostStatePrefix = "xyz.openbmc_project.State.Host.HostState.";
+constexpr auto hostTransition = "RequestedHostTransition";
+constexpr auto hostTransitionOn =
+    "xyz.openbmc_project.State.Host.Transition.On";
+constexpr auto hostTransitionOff =
+    "xyz.openbmc_project.State.Host.Transition.Off";
+constexpr auto hostTransitionReboot =
+    "xyz.openbmc_project.State.Host.Transition.Reboot";
+constexpr auto hostTransitionWarmReboot =
+    "xyz.openbmc_project.State.Host.Transition.GracefulWarmReboot";
+constexpr auto hostTransitionForceWarmReboot =
+    "xyz.openbmc_project.State.Host.Transition.ForceWarmReboot";
+
+constexpr auto bootProgressIface = "xyz.openbmc_project.State.Boot.Progress";
+constexpr auto osStatusIface =
+    "xyz.openbmc_project.State.OperatingSystem.Status";
+constexpr auto bootProgressOsRunning =
+    "xyz.openbmc_project.State.Boot.Progress.ProgressStages.OSRunning";
+constexpr auto osStatusStandby =
+    "xyz.openbmc_project.State.OperatingSystem.Status.OSStatus.Standby";
+
+constexpr auto postCodePathPrefix = "/xyz/openbmc_project/state/boot/raw";
+constexpr auto postCodePath = "/xyz/openbmc_project/state/boot/raw0";
+constexpr auto postCodeIface = "xyz.openbmc_project.State.Boot.Raw";
+constexpr auto postCodeProperty = "Value";
+
+// Boot override settings, the host index is appended to the path prefix
+constexpr auto bootSettingsPathPrefix = "/xyz/openbmc_project/control/host";
+constexpr auto bootSettingsPathSuffix = "/boot";
+constexpr auto bootOncePathSuffix = "/boot/one_time";
+constexpr auto bootSourceIface = "xyz.openbmc_project.Control.Boot.Source";
+constexpr auto bootSourceProperty = "BootSource";
+constexpr auto bootSourcePrefix =
+    "xyz.openbmc_project.Control.Boot.Source.Sources.";
+constexpr auto bootModeIface = "xyz.openbmc_project.Control.Boot.Mode";
+constexpr auto bootModeProperty = "BootMode";
+constexpr auto bootModePrefix = "xyz.openbmc_project.Control.Boot.Mode.Modes.";
+constexpr auto objectEnableIface = "xyz.openbmc_project.Object.Enable";
+constexpr auto objectEnableProperty = "Enabled";
+
+constexpr Property<std::string> chassisStateProperty{chassisPath, chassisIface,
+                                                     chassisState};
+constexpr Property<std::string> chassisTransitionProperty{
+    chassisPath, chassisIface, chassisTransition};
+constexpr Property<uint64_t> chassisLastChangeProperty{
+    chassisPath, chassisIface, "LastStateChangeTime"};
+constexpr Property<std::string> hostStateProperty{hostPath, hostIface,
+                                                  hostState};
+constexpr Property<std::string> hostTransitionProperty{hostPath, hostIface,
+                                                       hostTransition};
+constexpr Property<uint64_t> hostLastChangeProperty{hostPath, hostIface,
+                                                    "LastStateChangeTime"};
+constexpr Property<std::string> bootProgressProperty{
+    hostPath, bootProgressIface, "BootProgress"};
+constexpr Property<std::string> osStatusProperty{hostPath, osStatusIface,
+                                                 "OperatingSystemState"};
+
+/**
+ * @brief Remove class name form the property value
+ *        For example 'xyz.foo.bar.value' -> 'value'
+ *
+ * @param value - Original value
+ *
+ * @return trimmed value
+ */
+inline std::string trimClassName(const std::string& value)
+{
+    auto last = value.rfind('.');
+    if (last && last != std::string::npos)
+    {
+        return value.substr(last + 1);
+    }
+    return value;
+}
+
+} // namespace hostpwrctl
@@ -0,0 +1,195 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#include "statecache.hpp"
+
+#include "util.hpp"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+namespace hostpwrctl
+{
+
+/** @brief Number of attempts to get the consistent snapshot copy */
+constexpr auto readAttempts = 1000;
+
+/**
+ * @brief Copy the string to the fixed size buffer
+ *
+ * @param dst - destination buffer
+ * @param src - source string
+ */
+static void copyState(char (&dst)[StateSnapshot::stateSize],
+                      const std::string& src)
+{
+    size_t len = std::min(src.size(), sizeof(dst) - 1);
+    memcpy(dst, src.data(), len);
+    memset(dst + len, 0, sizeof(dst) - len);
+}
+
+StateCache::~StateCache()
+{
+    if (snapshot)
+    {
+        munmap(snapshot, sizeof(StateSnapshot));
+    }
+    if (fd != -1)
+    {
+        close(fd);
+    }
+}
+
+bool StateCache::publish(const char* path)
+{
+    if (!createParentDir(path))
+    {
+        return false;
+    }
+
+    fd = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1)
+    {
+        fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) == -1)
+    {
+        fprintf(stderr, "State snapshot %s is already published: %s\n", path,
+                strerror(errno));
+        return false;
+    }
+    if (ftruncate(fd, sizeof(StateSnapshot)) == -1)
+    {
+        fprintf(stderr, "Unable to resize %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    void* addr = mmap(nullptr, sizeof(StateSnapshot), PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+    {
+        fprintf(stderr, "Unable to map %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    snapshot = static_cast<StateSnapshot*>(addr);
+
+    // Odd sequence marks the snapshot as incomplete until the first update
+    snapshot->sequence.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    snapshot->magic = StateSnapshot::magicValue;
+    snapshot->version = StateSnapshot::layoutVersion;
+    snapshot->publisher = static_cast<uint32_t>(getpid());
+
+    return true;
+}
+
+bool StateCache::open(const char* path)
+{
+    fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 ||
+        st.st_size < static_cast<off_t>(sizeof(StateSnapshot)))
+    {
+        fprintf(stderr, "State snapshot %s is not initialized\n", path);
+        return false;
+    }
+
+    void* addr = mmap(nullptr, sizeof(StateSnapshot), PROT_READ, MAP_SHARED,
+                      fd, 0);
+    if (addr == MAP_FAILED)
+    {
+        fprintf(stderr, "Unable to map %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    snapshot = static_cast<StateSnapshot*>(addr);
+
+    if (snapshot->magic != StateSnapshot::magicValue ||
+        snapshot->version != StateSnapshot::layoutVersion)
+    {
+        fprintf(stderr, "State snapshot %s has unsupported format\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+void StateCache::update(const std::string& chassisState,
+                        const std::string& hostState)
+{
+    if (!snapshot)
+    {
+        return;
+    }
+
+    // Only the publisher writes, so the relaxed load is enough here.
+    // The first update after publish() starts with the odd counter.
+    uint32_t seq = snapshot->sequence.load(std::memory_order_relaxed) | 1;
+    snapshot->sequence.store(seq, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    copyState(snapshot->chassisState, chassisState);
+    copyState(snapshot->hostState, hostState);
+    snapshot->updated = monotonicNow();
+
+    snapshot->sequence.store(seq + 1, std::memory_order_release);
+}
+
+bool StateCache::read(CachedState& state) const
+{
+    if (!snapshot)
+    {
+        return false;
+    }
+
+    for (int attempt = 0; attempt < readAttempts; ++attempt)
+    {
+        uint32_t seq = snapshot->sequence.load(std::memory_order_acquire);
+        if (seq & 1)
+        {
+            continue;
+        }
+
+        char chassis[StateSnapshot::stateSize];
+        char host[StateSnapshot::stateSize];
+        memcpy(chassis, snapshot->chassisState, sizeof(chassis));
+        memcpy(host, snapshot->hostState, sizeof(host));
+        uint32_t publisher = snapshot->publisher;
+        uint64_t updated = snapshot->updated;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (snapshot->sequence.load(std::memory_order_relaxed) != seq)
+        {
+            continue;
+        }
+
+        chassis[sizeof(chassis) - 1] = 0;
+        host[sizeof(host) - 1] = 0;
+        state.chassisState = chassis;
+        state.hostState = host;
+        state.publisher = static_cast<pid_t>(publisher);
+        uint64_t now = monotonicNow();
+        state.age = now > updated ? now - updated : 0;
+        return true;
+    }
+
+    return false;
+}
+
+} // namespace hostpwrctl
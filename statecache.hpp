@@ -0,0 +1,113 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace hostpwrctl
+{
+
+/**
+ * @brief Layout of the power state snapshot file.
+ *
+ *        The publisher increments the sequence counter before and after
+ *        each update, so the counter is odd while the update is in progress
+ *        (seqlock). Readers copy the data and retry if the counter was
+ *        changed meanwhile, so they never block the publisher.
+ */
+struct StateSnapshot
+{
+    static constexpr uint32_t magicValue = 0x53505748; // "HWPS"
+    static constexpr uint32_t layoutVersion = 1;
+    static constexpr size_t stateSize = 96;
+
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint32_t> sequence;
+    uint32_t publisher;  // PID of the publisher process
+    uint64_t updated;    // CLOCK_MONOTONIC time of the last update, us
+    char chassisState[stateSize];
+    char hostState[stateSize];
+};
+
+/**
+ * @brief Consistent copy of the power state snapshot
+ */
+struct CachedState
+{
+    std::string chassisState;
+    std::string hostState;
+    pid_t publisher;
+    uint64_t age; // time since the last update, us
+};
+
+/**
+ * @brief Memory mapped power state snapshot
+ */
+class StateCache
+{
+  public:
+    static constexpr auto defaultPath = "/run/hostpwrctl/state";
+
+    StateCache() = default;
+    StateCache(const StateCache&) = delete;
+    StateCache& operator=(const StateCache&) = delete;
+    ~StateCache();
+
+    /**
+     * @brief Create the snapshot file and map it for writing.
+     *        Only one publisher may hold the file at once.
+     *
+     * @param path - snapshot file path
+     *
+     * @return false on error
+     */
+    bool publish(const char* path);
+
+    /**
+     * @brief Map the existing snapshot file for reading
+     *
+     * @param path - snapshot file path
+     *
+     * @return false on error
+     */
+    bool open(const char* path);
+
+    /**
+     * @brief Check if the snapshot is mapped
+     */
+    bool isOpen() const
+    {
+        return snapshot != nullptr;
+    }
+
+    /**
+     * @brief Update the snapshot
+     *
+     * @param chassisState - current chassis power state
+     * @param hostState    - current host state
+     */
+    void update(const std::string& chassisState, const std::string& hostState);
+
+    /**
+     * @brief Get consistent copy of the snapshot
+     *
+     * @param state - destination
+     *
+     * @return false if the snapshot is not ready or being updated
+     */
+    bool read(CachedState& state) const;
+
+  private:
+    int fd = -1;
+    StateSnapshot* snapshot = nullptr;
+};
+
+} // namespace hostpwrctl
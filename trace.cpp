@@ -0,0 +1,181 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#include "trace.hpp"
+
+#include "util.hpp"
+
+#include <unistd.h>
+
+#include <cstdio>
+
+namespace hostpwrctl
+{
+
+/** @brief Thread id of the D-Bus calls track */
+constexpr unsigned callsTrack = 1;
+
+/**
+ * @brief Escape the string for JSON
+ */
+static std::string escape(const std::string& value)
+{
+    std::string out;
+    out.reserve(value.size());
+    for (char c : value)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        }
+        else
+        {
+            out += c;
+        }
+    }
+    return out;
+}
+
+void Trace::enable(const std::string& name)
+{
+    enabled = true;
+    pid = getpid();
+    process = name;
+    tracks["D-Bus calls"] = callsTrack;
+}
+
+uint64_t Trace::now()
+{
+    return monotonicNow();
+}
+
+void Trace::call(uint64_t id, const std::string& name,
+                 const std::string& details, uint64_t start,
+                 const char* error)
+{
+    if (!enabled)
+    {
+        return;
+    }
+
+    std::string extra = ",\"cat\":\"dbus\",\"id\":" + std::to_string(id);
+    std::string args = ",\"args\":{\"call\":\"" + escape(details) + "\"";
+    if (error)
+    {
+        args += ",\"error\":\"" + escape(error) + "\"";
+    }
+    args += "}";
+
+    append("b", name, callsTrack, start, extra + args);
+    append("e", name, callsTrack, now(), extra);
+}
+
+void Trace::state(const std::string& track, const std::string& value)
+{
+    if (!enabled)
+    {
+        return;
+    }
+
+    auto tid = getTrack(track);
+    auto ts = now();
+    auto it = spans.find(tid);
+    if (it != spans.end())
+    {
+        if (it->second.value == value)
+        {
+            return;
+        }
+        append("X", it->second.value, tid, it->second.start,
+               ",\"dur\":" + std::to_string(ts - it->second.start));
+    }
+    spans[tid] = {value, ts};
+}
+
+bool Trace::write(const char* path)
+{
+    if (!enabled)
+    {
+        return true;
+    }
+
+    auto ts = now();
+    for (const auto& [tid, span] : spans)
+    {
+        append("X", span.value, tid, span.start,
+               ",\"dur\":" + std::to_string(ts - span.start));
+    }
+    spans.clear();
+
+    FILE* file = fopen(path, "w");
+    if (!file)
+    {
+        perror(path);
+        return false;
+    }
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    fprintf(file,
+            "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,"
+            "\"args\":{\"name\":\"%s\"}}",
+            pid, escape(process).c_str());
+    for (const auto& [name, tid] : tracks)
+    {
+        fprintf(file,
+                ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,"
+                "\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                pid, tid, escape(name).c_str());
+    }
+    for (const auto& event : events)
+    {
+        fprintf(file, ",\n%s", event.c_str());
+    }
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+    bool success = !ferror(file);
+    if (fclose(file) != 0 || !success)
+    {
+        fprintf(stderr, "Unable to write trace file %s\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+unsigned Trace::getTrack(const std::string& track)
+{
+    auto it = tracks.find(track);
+    if (it != tracks.end())
+    {
+        return it->second;
+    }
+    unsigned tid = callsTrack + static_cast<unsigned>(tracks.size());
+    tracks[track] = tid;
+    return tid;
+}
+
+void Trace::append(const char* phase, const std::string& name, unsigned tid,
+                   uint64_t ts, const std::string& extra)
+{
+    events.push_back("{\"ph\":\"" + std::string(phase) + "\",\"name\":\"" +
+                     escape(name) + "\",\"pid\":" + std::to_string(pid) +
+                     ",\"tid\":" + std::to_string(tid) +
+                     ",\"ts\":" + std::to_string(ts) + extra + "}");
+}
+
+Trace& tracer()
+{
+    static Trace trace;
+    return trace;
+}
+
+} // namespace hostpwrctl
@@ -0,0 +1,107 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace hostpwrctl
+{
+
+/**
+ * @brief Timeline of the power operation in the Chrome trace event format,
+ *        the file can be loaded into Perfetto or chrome://tracing.
+ *
+ *        D-Bus calls are written as async slices, the state values as
+ *        consecutive slices of the named tracks. Nothing is collected
+ *        unless the trace is enabled.
+ */
+class Trace
+{
+  public:
+    /**
+     * @brief Enable the trace collection
+     *
+     * @param process - process name shown in the trace viewer
+     */
+    void enable(const std::string& process);
+
+    /**
+     * @brief Check if the trace is collected
+     */
+    bool isEnabled() const
+    {
+        return enabled;
+    }
+
+    /**
+     * @brief Get current time stamp
+     *
+     * @return CLOCK_MONOTONIC time, us
+     */
+    static uint64_t now();
+
+    /**
+     * @brief Add D-Bus method call slice
+     *
+     * @param id      - unique call id (message cookie)
+     * @param name    - method name
+     * @param details - call details (destination, object path)
+     * @param start   - time of the call
+     * @param error   - error name, null on success
+     */
+    void call(uint64_t id, const std::string& name, const std::string& details,
+              uint64_t start, const char* error);
+
+    /**
+     * @brief Start the new state slice on the track,
+     *        the previous slice of the track is closed
+     *
+     * @param track - track name
+     * @param value - state value
+     */
+    void state(const std::string& track, const std::string& value);
+
+    /**
+     * @brief Close the open slices and write the trace file
+     *
+     * @param path - output file path
+     *
+     * @return false on error
+     */
+    bool write(const char* path);
+
+  private:
+    /** @brief Open state slice */
+    struct Span
+    {
+        std::string value;
+        uint64_t start;
+    };
+
+    /** @brief Get the thread id of the track */
+    unsigned getTrack(const std::string& track);
+
+    /** @brief Append the event with the common fields */
+    void append(const char* phase, const std::string& name, unsigned tid,
+                uint64_t ts, const std::string& extra);
+
+    bool enabled = false;
+    int pid = 0;
+    std::string process;
+    std::map<std::string, unsigned> tracks;
+    std::map<unsigned, Span> spans;
+    std::vector<std::string> events;
+};
+
+/**
+ * @brief Get the process wide trace
+ */
+Trace& tracer();
+
+} // namespace hostpwrctl
@@ -0,0 +1,43 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#include "util.hpp"
+
+#include <sys/stat.h>
+#include <time.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+namespace hostpwrctl
+{
+
+uint64_t monotonicNow()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+bool createParentDir(const std::string& path)
+{
+    auto slash = path.rfind('/');
+    if (slash == std::string::npos || slash == 0)
+    {
+        return true;
+    }
+
+    std::string dir = path.substr(0, slash);
+    if (mkdir(dir.c_str(), 0755) == -1 && errno != EEXIST)
+    {
+        fprintf(stderr, "Unable to create directory %s: %s\n", dir.c_str(),
+                strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+} // namespace hostpwrctl
@@ -0,0 +1,68 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ * Copyright (C) 2021 YADRO.
+ */
+
+#pragma once
+
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+namespace hostpwrctl
+{
+
+/**
+ * @brief Get current monotonic time
+ *
+ * @return CLOCK_MONOTONIC time, us
+ */
+uint64_t monotonicNow();
+
+/**
+ * @brief Convert the duration to seconds
+ *
+ * @param duration - duration to convert
+ *
+ * @return number of seconds
+ */
+inline double toSeconds(std::chrono::steady_clock::duration duration)
+{
+    return std::chrono::duration<double>(duration).count();
+}
+
+/**
+ * @brief Create the directory of the file unless it exists,
+ *        only the last path component is created
+ *
+ * @param path - file path
+ *
+ * @return false on error
+ */
+bool createParentDir(const std::string& path);
+
+/**
+ * @brief Parse unsigned integer argument
+ *
+ * @param arg   - argument string
+ * @param value - parsed value
+ *
+ * @return false if the argument is not a valid number
+ */
+inline bool parseUnsigned(const char* arg, unsigned& value)
+{
+    char* end;
+    errno = 0;
+    unsigned long num = strtoul(arg, &end, 10);
+    if (*end || end == arg || errno || num > UINT_MAX)
+    {
+        return false;
+    }
+    value = static_cast<unsigned>(num);
+    return true;
+}
+
+} // namespace hostpwrctl